@@ -8,12 +8,22 @@
 #include "sfzero/SF2Generator.cpp" 
 #include "sfzero/SF2Reader.cpp" 
 #include "sfzero/SF2Sound.cpp" 
+#include "sfzero/SFZBankCache.cpp" 
 #include "sfzero/SFZDebug.cpp" 
 #include "sfzero/SFZEG.cpp" 
+#include "sfzero/SFZMultiSynth.cpp" 
 #include "sfzero/SFZReader.cpp" 
 #include "sfzero/SFZRegion.cpp" 
+#include "sfzero/SFZRegionTable.cpp" 
+#include "sfzero/SFZReleasePool.cpp" 
+#include "sfzero/SFZRender.cpp" 
+#include "sfzero/SFZRenderPool.cpp" 
 #include "sfzero/SFZSample.cpp" 
+#include "sfzero/SFZSampleArena.cpp" 
+#include "sfzero/SFZSampleData.cpp" 
+#include "sfzero/SFZSampleLoader.cpp" 
 #include "sfzero/SFZSound.cpp" 
+#include "sfzero/SFZStreamPool.cpp" 
 #include "sfzero/SFZSynth.cpp" 
 #include "sfzero/SFZVoice.cpp" 
 
@@ -14,19 +14,38 @@ END_JUCE_MODULE_DECLARATION
 #ifndef INCLUDED_SFZEROMT_H
 #define INCLUDED_SFZEROMT_H
 
+/** Config: SFZERO_USE_SIMD
+    Enables the SSE2/AVX2/NEON voice render kernels. Disable to use portable scalar code only.
+*/
+#ifndef SFZERO_USE_SIMD
+ #define SFZERO_USE_SIMD 1
+#endif
+
 #include "sfzero/RIFF.h"
 #include "sfzero/SF2.h"
 #include "sfzero/SF2Generator.h"
 #include "sfzero/SF2Reader.h"
 #include "sfzero/SF2Sound.h"
 #include "sfzero/SF2WinTypes.h"
+#include "sfzero/SFZBankCache.h"
 #include "sfzero/SFZCommon.h"
 #include "sfzero/SFZDebug.h"
 #include "sfzero/SFZEG.h"
+#include "sfzero/SFZLookupTable.h"
+#include "sfzero/SFZMultiSynth.h"
 #include "sfzero/SFZReader.h"
 #include "sfzero/SFZRegion.h"
+#include "sfzero/SFZRegionTable.h"
+#include "sfzero/SFZReleasePool.h"
+#include "sfzero/SFZRender.h"
+#include "sfzero/SFZRenderPool.h"
 #include "sfzero/SFZSample.h"
+#include "sfzero/SFZSampleArena.h"
+#include "sfzero/SFZSampleData.h"
+#include "sfzero/SFZSampleLoader.h"
+#include "sfzero/SFZSIMD.h"
 #include "sfzero/SFZSound.h"
+#include "sfzero/SFZStreamPool.h"
 #include "sfzero/SFZSynth.h"
 #include "sfzero/SFZVoice.h"
 
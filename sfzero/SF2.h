@@ -110,7 +110,12 @@ namespace sfzero
             #include "sf2-chunks/shdr.h"
             void readFrom(juce::InputStream *file);
             
+            /** SF3: the sample is Ogg Vorbis compressed. Its start and end are byte positions
+                in the sample data then, and its loop points are relative to its start. */
+            bool isCompressed() const { return (sampleType & compressedType) != 0; }
+            
             static const int sizeInFile = 46;
+            static const word compressedType = 0x10;
         };
         
         struct Hydra
@@ -16,6 +16,7 @@
 #include "SF2.h"
 #include "SF2Generator.h"
 #include "SF2Sound.h"
+#include "SFZSIMD.h"
 
 using namespace juce;
 using namespace sfzero;
@@ -59,12 +60,18 @@ void SF2Reader::read()
         return;
     }
     
+    // With sf2StoreLazy, samples are loaded individually, with the zero frames that
+    // follow each sample in the file. Compressed samples (SF3) are always decoded
+    // individually.
+    const bool lazy = (sound_->sharedSamples()->getStorage() == sf2StoreLazy);
+    static const int guardFrames = 46;
+    
     // Read each preset.
     for (int whichPreset = 0; whichPreset < hydra.phdrNumItems - 1; ++whichPreset)
     {
         SF2::phdr *phdr = &hydra.phdrItems[whichPreset];
         Preset *preset = new Preset(phdr->presetName, phdr->bank, phdr->preset);
-        sound_->addPreset(preset);
+        sound_->sharedSamples()->addPreset(preset);
         
         // Zones
         /** @todo Handle more global zone generators/modulators than initialAttentuation */
@@ -150,7 +157,33 @@ void SF2Reader::read()
                                     
                                     Region *newRegion = new Region();
                                     *newRegion = zoneRegion;
-                                    newRegion->sample = sound_->sampleFor(shdr->sampleRate);
+                                    if (shdr->isCompressed())
+                                    {
+                                        // Loop points are relative to the sample already. Its end is
+                                        // known after decoding only, so the end is kept as an offset
+                                        // to it, applied by the voice.
+                                        const Range<int64> range (shdr->start, shdr->end);
+                                        newRegion->sample = sound_->sharedSamples()->getSample(whichSample, shdr->sampleRate, range, true);
+                                        newRegion->sample->name = String(shdr->sampleName, 20);
+                                        newRegion->offset -= shdr->start;
+                                        newRegion->end -= shdr->end;
+                                        newRegion->end_from_sample_end = true;
+                                    }
+                                    else if (lazy)
+                                    {
+                                        // A sample per shdr record, with positions relative to it
+                                        const Range<int64> range (shdr->start, shdr->end + guardFrames);
+                                        newRegion->sample = sound_->sharedSamples()->getSample(whichSample, shdr->sampleRate, range);
+                                        newRegion->sample->name = String(shdr->sampleName, 20);
+                                        newRegion->offset -= shdr->start;
+                                        newRegion->end -= shdr->start;
+                                        newRegion->loop_start -= shdr->start;
+                                        newRegion->loop_end -= shdr->start;
+                                    }
+                                    else
+                                    {
+                                        newRegion->sample = sound_->sampleFor(shdr->sampleRate);
+                                    }
                                     preset->addRegion(newRegion);
                                     hadSampleID = true;
                                 }
@@ -208,12 +241,12 @@ void SF2Reader::read()
 #endif
 }
 
-AudioSampleBuffer *SF2Reader::readSampleData (double *progressVar, Thread *thread)
+int SF2Reader::seekToSampleData()
 {
     if (file_ == nullptr)
     {
         sound_->addError("Couldn't open file.");
-        return nullptr;
+        return -1;
     }
     
     // Find the "sdta" chunk.
@@ -247,44 +280,139 @@ AudioSampleBuffer *SF2Reader::readSampleData (double *progressVar, Thread *threa
     if (!found)
     {
         sound_->addError("SF2 is missing its \"smpl\" chunk.");
-        return nullptr;
+        return -1;
     }
     
     /* Note: In standard SF2 format, all samples are 16-bit uncompressed (short),
      saved in a single chunk of data. Sample's meta data (loops) refer directly
-     to offsets within this chunk. This makes loading the samples a snap,
-     however, it does not support compressed formats like SF3, which would
-     require each sample to be located and loaded individually.
+     to offsets within this chunk. This makes loading the samples a snap.
+     Compressed samples of SF3 files are located by their byte positions in
+     this chunk instead, and decoded individually (see decodeCompressedSample()).
      */
+    return (int)chunk.size / sizeof(short);
+}
+
+int SF2Reader::locateSampleData (int64 &fileOffset)
+{
+    int numSamples = seekToSampleData();
+    if (numSamples >= 0)
+    {
+        fileOffset = file_->getPosition();
+    }
+    return numSamples;
+}
+
+void SF2Reader::convertInt16ToFloat (float *out, const int16 *in, int numSamples)
+{
+    // If we ever need to compile for big-endian platforms, we'll need to byte-swap here.
+    typedef FloatVector V;
+    const V::Type scale = V::set1(1.0f / 32767.0f);
+    for (; numSamples >= V::width; numSamples -= V::width, in += V::width, out += V::width)
+    {
+        V::store(out, V::mul(V::load(in), scale));
+    }
+    for (; numSamples > 0; --numSamples)
+    {
+        *out++ = *in++ / 32767.0f;
+    }
+}
+
+AudioSampleBuffer *SF2Reader::decodeCompressedSample (const void *data, size_t numBytes)
+{
+#if JUCE_USE_OGGVORBIS
+    OggVorbisAudioFormat format;
+    std::unique_ptr<AudioFormatReader> reader (format.createReaderFor(new MemoryInputStream(data, numBytes, false), true));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->lengthInSamples > std::numeric_limits<int>::max())
+    {
+        return nullptr;
+    }
+    const int numSamples = static_cast<int>(reader->lengthInSamples);
+    AudioSampleBuffer *buffer = new AudioSampleBuffer(1, numSamples);
+    reader->read(buffer, 0, numSamples, 0, true, false);
+    return buffer;
+#else
+    ignoreUnused(data, numBytes);
+    return nullptr;
+#endif
+}
+
+namespace
+{
+    class ConvertJob : public ThreadPoolJob
+    {
+    public:
+        ConvertJob (float *out, const int16 *in, int numSamples) :
+            ThreadPoolJob ("SF2 sample conversion"),
+            out_ (out), in_ (in), numSamples_ (numSamples)
+        {}
+        
+        JobStatus runJob() override
+        {
+            SF2Reader::convertInt16ToFloat(out_, in_, numSamples_);
+            return jobHasFinished;
+        }
+        
+    private:
+        float *out_;
+        const int16 *in_;
+        int numSamples_;
+    };
+}
+
+AudioSampleBuffer *SF2Reader::readSampleData (double *progressVar, Thread *thread)
+{
+    int numSamples = seekToSampleData();
+    if (numSamples < 0)
+    {
+        return nullptr;
+    }
+    
+    // Read in chunks into two buffers alternately. While one chunk is read, the one
+    // before is converted by the worker threads, a slice of minSliceSize or more each.
+    // Small files are converted on this thread.
+    static const int bufferSize = 1 << 20;
+    static const int minSliceSize = 1 << 16;
     
-    static const int bufferSize = 128000;
-    int numSamples = (int)chunk.size / sizeof(short);
     AudioSampleBuffer *sampleBuffer = new AudioSampleBuffer(1, numSamples);
     //sound_->addError(String(numSamples) + " samples");
     
-    // Read and convert in small chunks, so progress bar can be updated
+    const int numWorkers = jlimit(0, 8, SystemStats::getNumCpus() - 1);
+    ScopedPointer<ThreadPool> pool = (numWorkers > 0 && numSamples > bufferSize) ? new ThreadPool(numWorkers) : nullptr;
+    OwnedArray<ThreadPoolJob> jobs[2];
+    HeapBlock<int16> buffers[2];
+    buffers[0].malloc(jmin(bufferSize, numSamples));
+    buffers[1].malloc(jmin(bufferSize, numSamples));
+    
     int   samplesLeft = numSamples;
     float *out = sampleBuffer->getWritePointer(0);
-    ScopedPointer<short> buffer = new short[bufferSize];
+    bool  cancelled = false;
     
-    while (samplesLeft > 0)
+    for (int current = 0; samplesLeft > 0; current ^= 1)
     {
-        // Read the buffer.
-        int samplesToRead = bufferSize;
-        if (samplesToRead > samplesLeft)
+        // Wait until the buffer is converted, before reading into it again
+        for (ThreadPoolJob *job : jobs[current])
+            pool->waitForJobToFinish(job, -1);
+        jobs[current].clear();
+        
+        int samplesToRead = jmin(bufferSize, samplesLeft);
+        file_->read(buffers[current], samplesToRead * sizeof(int16));
+        
+        if (pool == nullptr)
         {
-            samplesToRead = samplesLeft;
+            convertInt16ToFloat(out, buffers[current], samplesToRead);
         }
-        file_->read(buffer, samplesToRead * sizeof(short));
-        
-        // Convert from signed 16-bit to float.
-        int samplesToConvert = samplesToRead;
-        short *in = buffer;
-        for (; samplesToConvert > 0; --samplesToConvert)
+        else
         {
-            // If we ever need to compile for big-endian platforms, we'll need to byte-swap here.
-            *out++ = *in++ / 32767.0f;
+            const int numSlices = jlimit(1, numWorkers, samplesToRead / minSliceSize);
+            const int sliceSize = (samplesToRead + numSlices - 1) / numSlices;
+            for (int start = 0; start < samplesToRead; start += sliceSize)
+            {
+                ThreadPoolJob *job = new ConvertJob(out + start, buffers[current] + start, jmin(sliceSize, samplesToRead - start));
+                jobs[current].add(job);
+                pool->addJob(job, false);
+            }
         }
+        out += samplesToRead;
         samplesLeft -= samplesToRead;
         
         if (progressVar)
@@ -293,11 +421,23 @@ AudioSampleBuffer *SF2Reader::readSampleData (double *progressVar, Thread *threa
         }
         if (thread && thread->threadShouldExit())
         {
-            delete sampleBuffer;
-            return nullptr;
+            cancelled = true;
+            break;
         }
     }
     
+    if (pool != nullptr)
+    {
+        for (int i = 0; i < 2; ++i)
+            for (ThreadPoolJob *job : jobs[i])
+                pool->waitForJobToFinish(job, -1);
+    }
+    
+    if (cancelled)
+    {
+        delete sampleBuffer;
+        return nullptr;
+    }
     if (progressVar)
     {
         *progressVar = 1.0;
@@ -305,6 +445,47 @@ AudioSampleBuffer *SF2Reader::readSampleData (double *progressVar, Thread *threa
     return sampleBuffer;
 }
 
+int SF2Reader::readSampleData16 (HeapBlock<int16> &data, double *progressVar, Thread *thread)
+{
+    int numSamples = seekToSampleData();
+    if (numSamples < 0)
+    {
+        return 0;
+    }
+    
+    static const int bufferSize = 128000;
+    data.malloc(numSamples);
+    
+    // Read in small chunks, so progress bar can be updated.
+    // If we ever need to compile for big-endian platforms, we'll need to byte-swap here.
+    int samplesLeft = numSamples;
+    int16 *out = data;
+    
+    while (samplesLeft > 0)
+    {
+        int samplesToRead = jmin(bufferSize, samplesLeft);
+        file_->read(out, samplesToRead * sizeof(int16));
+        out += samplesToRead;
+        samplesLeft -= samplesToRead;
+        
+        if (progressVar)
+        {
+            *progressVar = static_cast<float>(numSamples - samplesLeft) / numSamples;
+        }
+        if (thread && thread->threadShouldExit())
+        {
+            data.free();
+            return 0;
+        }
+    }
+    
+    if (progressVar)
+    {
+        *progressVar = 1.0;
+    }
+    return numSamples;
+}
+
 
 void SF2Reader::addGeneratorToRegion (word genOper, SF2::genAmountType *amount, Region *region)
 {
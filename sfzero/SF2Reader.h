@@ -40,7 +40,25 @@ namespace sfzero
         /** Reads shared sample data of all samples */
         juce::AudioSampleBuffer *readSampleData (double *progressVar = nullptr, juce::Thread *thread = nullptr);
         
+        /** Reads shared sample data of all samples as int16, without conversion.
+            Returns the number of samples read, or 0 on error. */
+        int readSampleData16 (juce::HeapBlock<juce::int16> &data, double *progressVar = nullptr, juce::Thread *thread = nullptr);
+        
+        /** Finds the "smpl" chunk without reading it, for memory mapping.
+            Returns its number of int16 samples, or -1 on error. */
+        int locateSampleData (juce::int64 &fileOffset);
+        
+        /** Converts signed 16-bit samples to float in [-1, 1] */
+        static void convertInt16ToFloat (float *out, const juce::int16 *in, int numSamples);
+        
+        /** Decodes an Ogg Vorbis compressed sample of a SF3 file. Returns a mono buffer,
+            or nullptr if it can't be decoded. Thread-safe. */
+        static juce::AudioSampleBuffer *decodeCompressedSample (const void *data, size_t numBytes);
+        
     private:
+        /** Positions the file at the start of the "smpl" chunk, returns its number of samples or -1 */
+        int seekToSampleData();
+        
         SF2Sound *sound_;
         std::unique_ptr<juce::FileInputStream> file_;
         
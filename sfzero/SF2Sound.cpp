@@ -12,7 +12,6 @@
  ***********************************************************************/
 
 #include "SF2Sound.h"
-#include "SF2Reader.h"
 #include "SFZSample.h"
 #include "SFZSharedResources.h"
 
@@ -21,22 +20,21 @@ using namespace sfzero;
 
 
 SF2Sound::SF2Sound (const File &fileIn, int channel) :
-    Sound (fileIn, channel)
+    Sound (fileIn, channel),
+    selectedPreset_ (nullptr)
 {
+    selectedIndex_.set(0);
+    selectRegionTable(&emptyRegionTable_);
 }
 
 SF2Sound::~SF2Sound()
 {
-    // "presets_" owns the regions, so clear them out of "regions" so ~SFZSound() doesn't try to delete them.
-    getRegions().clear();
-    
-    HashMap<int, Preset*>::Iterator i (presets_);
-    while (i.next())
+    // Shared resources own the presets, their regions and tables
+    if (selectedPreset_ != nullptr)
     {
-        delete i.getValue();
+        --selectedPreset_->numSelections;
+        sf2Samples_->requestResidencyUpdate();
     }
-    presets_.clear();
-    
     sf2Samples_ = nullptr;
 }
 
@@ -50,15 +48,9 @@ SharedResourcesSF2::Ptr SF2Sound::sharedSamples()
     return sf2Samples_;
 }
 
-void SF2Sound::addPreset (Preset *preset)
-{
-    presets_.set(preset->index(), preset);
-}
-
 void SF2Sound::loadRegions()
 {
-    SF2Reader reader(this, getFile());
-    reader.read();
+    sharedSamples()->loadPresets(this);
     setProgramSelection(ProgramSelection());
 }
 
@@ -71,26 +63,33 @@ void SF2Sound::loadSamples(AudioFormatManager *formatManager, double *progressVa
 ProgramSelection& SF2Sound::getProgramSelection ()
 {
     // returns the current selection incl. name
+    // Not on the audio thread, which only sets selectedIndex_
+    selection_ = ProgramSelection(selectedIndex_.get());
+    selection_.name = getProgramName(selection_);
     return selection_;
 }
 
 void SF2Sound::setProgramSelection (const ProgramSelection& selection)
 {
-    // It is important to call this under a lock from Synth.
+    // Wait-free, as program change messages are handled on the audio thread:
+    // selects the prebuilt table of the preset, without copying regions or the name.
     // Unused programs can be selected, but will produce no sound.
     
-    selection_ = selection;
+    Preset* preset = getPreset(selection.index());
+    RegionTable* table = preset ? preset->getRegionTable() : nullptr;
     
-    Preset* preset = presets_[selection.index()];
-    if (preset)
+    selectRegionTable(table ? table : &emptyRegionTable_);
+    selectedIndex_.set(selection.index());
+    
+    // With sf2StoreLazy, samples of the preset are loaded on the SampleLoader's thread
+    if (preset != selectedPreset_)
     {
-        getRegions().clear();
-        getRegions().addArray(preset->regions);
-        selection_.name = preset->getName();
-        
-    } else {
-        getRegions().clear();
-        selection_.name = String();
+        if (preset != nullptr)
+            ++preset->numSelections;
+        if (selectedPreset_ != nullptr)
+            --selectedPreset_->numSelections;
+        selectedPreset_ = preset;
+        sf2Samples_->requestResidencyUpdate();
     }
 }
 
@@ -104,7 +103,7 @@ int SF2Sound::getProgramCount (int bank)
 String SF2Sound::getProgramName (const ProgramSelection& selection)
 {
     // Returns an empty default name for all unused program numbers
-    Preset* preset = presets_[selection.index()];
+    Preset* preset = getPreset(selection.index());
     if (preset)
         return preset->getName();
     else
@@ -117,7 +116,10 @@ ProgramList* SF2Sound::getProgramList()
     // The ordering of this list is NOT related to MIDI program numbers
     
     ProgramList* list = new ProgramList();
-    HashMap<int, Preset*>::Iterator i (presets_);
+    if (sf2Samples_ == nullptr)
+        return list;
+    
+    HashMap<int, Preset*>::Iterator i (sf2Samples_->getPresets());
     while (i.next())
     {
         list->add (new ProgramSelection (i.getValue()->getSelection()));
@@ -128,9 +130,18 @@ ProgramList* SF2Sound::getProgramList()
 }
 
 
+Preset* SF2Sound::getPreset (int index)
+{
+    // Not sharedSamples(), which may look up the shared resources on the audio thread
+    return sf2Samples_ != nullptr ? sf2Samples_->getPreset(index) : nullptr;
+}
+
 bool SF2Sound::hasBank (int bank)
 {
-    HashMap<int, Preset*>::Iterator i (presets_);
+    if (sf2Samples_ == nullptr)
+        return false;
+    
+    HashMap<int, Preset*>::Iterator i (sf2Samples_->getPresets());
     while (i.next())
     {
         ProgramSelection& selection = i.getValue()->getSelection();
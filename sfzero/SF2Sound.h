@@ -35,8 +35,6 @@ namespace sfzero
                          juce::Thread *thread = nullptr) override;
         
         
-        void addPreset(Preset *preset);
-        
         // Presets, channel and program selection:
         // Pass -1 for bank to request all banks
         int               getProgramCount(int bank) override;
@@ -50,7 +48,14 @@ namespace sfzero
     private:
         
         bool hasBank (int bank);
-        juce::HashMap<int, Preset*> presets_;
+        Preset* getPreset (int index);
+        // Selected for programs without a preset
+        RegionTable emptyRegionTable_;
+        // Program selected on the audio thread, see getProgramSelection().
+        // Presets are shared by all sounds of the file, the selection is per sound.
+        juce::Atomic<int> selectedIndex_;
+        // Counted in Preset::numSelections, so its samples are loaded with sf2StoreLazy
+        Preset* selectedPreset_;
         SharedResourcesSF2::Ptr sf2Samples_;
         
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SF2Sound)
@@ -0,0 +1,359 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZBankCache.h"
+#include "SFZRegion.h"
+#include "SFZSample.h"
+
+using namespace juce;
+using namespace sfzero;
+
+/*  Cache file layout, numbers little endian, Regions and floats as in memory:
+
+    int     magic, version, sizeof(Region), storage
+    int64   source size, source modification time (ms)
+    int64   sample data offset
+    int     sample data frames, of which shared frames
+    string  source path
+    int     errors,  per error:  string
+    int     samples, per sample: int shdr index (-1 if shared), int compressed, double rate,
+                                 int64 range start, int64 range end, string name,
+                                 int64 first frame, int frames of its data (0 if not cached)
+    int     presets, per preset: int bank, int program, string name, int regions,
+                                 per region: int sample (-1 for none), Region
+    float   sample data, at the sample data offset (aligned): shared data first, then
+            the data of samples */
+
+namespace
+{
+    const int sampleDataOffsetPosition = 32;
+    const int minHeaderSize = 49;
+
+    struct CachedSample
+    {
+        int index;
+        bool compressed;
+        double rate;
+        Range<int64> range;
+        String name;
+        int64 firstFrame;
+        int numFrames;
+    };
+}
+
+BankCache::BankCache (const File &directory, const File &source, SF2SampleStorage storage) :
+    file_ (directory.getChildFile(String::toHexString(source.getFullPathName().hashCode64()) + ".sf2cache")),
+    source_ (source),
+    storage_ (storage),
+    mappedFile_ (),
+    presetsRead_ (false),
+    complete_ (false),
+    sampleDataOffset_ (0),
+    sharedFrames_ (0)
+{
+}
+
+BankCache::~BankCache ()
+{
+}
+
+bool BankCache::readPresets (SharedResourcesSF2 &resources, StringArray &errors)
+{
+    if (!file_.existsAsFile())
+        return false;
+
+    mappedFile_.reset(new MemoryMappedFile(file_, MemoryMappedFile::readOnly));
+    const size_t size = mappedFile_->getSize();
+    if (mappedFile_->getData() == nullptr || size < minHeaderSize)
+    {
+        mappedFile_.reset();
+        return false;
+    }
+    MemoryInputStream in (mappedFile_->getData(), size, false);
+
+    // Stale or compiled by another build
+    if (in.readInt() != magic ||
+        in.readInt() != version ||
+        in.readInt() != static_cast<int>(sizeof(Region)) ||
+        in.readInt() != static_cast<int>(storage_) ||
+        in.readInt64() != source_.getSize() ||
+        in.readInt64() != source_.getLastModificationTime().toMilliseconds())
+    {
+        mappedFile_.reset();
+        return false;
+    }
+    const int64 sampleDataOffset = in.readInt64();
+    const int numFrames = in.readInt();
+    const int sharedFrames = in.readInt();
+    if (in.readString() != source_.getFullPathName() ||
+        numFrames < 0 ||
+        sharedFrames < 0 ||
+        sharedFrames > numFrames ||
+        sampleDataOffset < 0 ||
+        sampleDataOffset + numFrames * static_cast<int64>(sizeof(float)) > static_cast<int64>(size))
+    {
+        mappedFile_.reset();
+        return false;
+    }
+
+    // Read everything before changing resources, so a broken cache changes nothing
+    StringArray cachedErrors;
+    const int numErrors = in.readInt();
+    for (int i = 0; i < numErrors && !in.isExhausted(); ++i)
+    {
+        cachedErrors.add(in.readString());
+    }
+
+    Array<CachedSample> cachedSamples;
+    const int numSamples = in.readInt();
+    for (int i = 0; i < numSamples && !in.isExhausted(); ++i)
+    {
+        CachedSample sample;
+        sample.index = in.readInt();
+        sample.compressed = (in.readInt() != 0);
+        sample.rate = in.readDouble();
+        const int64 start = in.readInt64();
+        sample.range = Range<int64>(start, in.readInt64());
+        sample.name = in.readString();
+        sample.firstFrame = in.readInt64();
+        sample.numFrames = in.readInt();
+        if (sample.index < -1 || sample.numFrames < 0 || sample.firstFrame < sharedFrames ||
+            sample.firstFrame + sample.numFrames > numFrames)
+        {
+            mappedFile_.reset();
+            return false;
+        }
+        cachedSamples.add(sample);
+    }
+
+    OwnedArray<Preset> presets;
+    Array<int> sampleRefs;
+    const int numPresets = in.readInt();
+    for (int i = 0; i < numPresets && !in.isExhausted(); ++i)
+    {
+        const int bank = in.readInt();
+        const int program = in.readInt();
+        const String name (in.readString());
+        Preset *preset = presets.add(new Preset(name, bank, program));
+
+        const int numRegions = in.readInt();
+        if (numRegions < 0 || numRegions > in.getNumBytesRemaining() / static_cast<int64>(sizeof(int) + sizeof(Region)))
+        {
+            mappedFile_.reset();
+            return false;
+        }
+        for (int r = 0; r < numRegions; ++r)
+        {
+            const int sampleRef = in.readInt();
+            Region *region = new Region();
+            preset->addRegion(region);
+            if (sampleRef < -1 || sampleRef >= numSamples ||
+                in.read(region, static_cast<int>(sizeof(Region))) != static_cast<int>(sizeof(Region)))
+            {
+                mappedFile_.reset();
+                return false;
+            }
+            sampleRefs.add(sampleRef);
+        }
+    }
+    if (cachedErrors.size() != numErrors || cachedSamples.size() != numSamples || presets.size() != numPresets)
+    {
+        mappedFile_.reset();
+        return false;
+    }
+
+    // Hand the presets over, with the samples of the resources
+    sampleDataOffset_ = sampleDataOffset;
+    sharedFrames_ = sharedFrames;
+    complete_ = true;
+    Array<Sample*> samples;
+    for (const CachedSample &cached : cachedSamples)
+    {
+        if (cached.index >= 0)
+        {
+            Sample *sample = resources.getSample(cached.index, cached.rate, cached.range, cached.compressed);
+            sample->name = cached.name;
+            if (cached.numFrames > 0 && !sample->hasData())
+                sample->setBuffer(referToSampleData(cached.firstFrame, cached.numFrames));
+            else if (cached.compressed && storage_ != sf2StoreLazy)
+                complete_ = false;
+            samples.add(sample);
+        }
+        else
+        {
+            samples.add(resources.getSample(cached.rate));
+            if (storage_ == sf2StoreFloat && sharedFrames == 0)
+                complete_ = false;
+        }
+    }
+    int regionIndex = 0;
+    for (Preset *preset : presets)
+    {
+        for (Region *region : preset->regions)
+        {
+            const int sampleRef = sampleRefs[regionIndex++];
+            region->sample = (sampleRef >= 0) ? samples[sampleRef] : nullptr;
+        }
+        resources.addPreset(preset);
+    }
+    presets.clear(false);
+
+    errors = cachedErrors;
+    presetsRead_ = true;
+    return true;
+}
+
+AudioSampleBuffer *BankCache::referToSampleData (int64 frame, int numFrames)
+{
+    // Voices only read sample data, so the read-only mapping can be referred to
+    float *data = reinterpret_cast<float*>(static_cast<char*>(mappedFile_->getData()) + sampleDataOffset_) + frame;
+    return new AudioSampleBuffer(&data, 1, numFrames);
+}
+
+AudioSampleBuffer *BankCache::createSampleBuffer ()
+{
+    if (mappedFile_ == nullptr || sharedFrames_ <= 0)
+        return nullptr;
+
+    return referToSampleData(0, sharedFrames_);
+}
+
+bool BankCache::isComplete () const
+{
+    return presetsRead_ && complete_;
+}
+
+bool BankCache::write (SharedResourcesSF2 &resources, const StringArray &errors,
+                       const AudioSampleBuffer *sampleData)
+{
+    if (file_.getParentDirectory().createDirectory().failed())
+        return false;
+
+    // Regions refer to samples by their position in this table
+    SortedSet<Sample*> samples;
+    for (HashMap<int, Preset*>::Iterator i(resources.getPresets()); i.next();)
+    {
+        for (Region *region : i.getValue()->regions)
+        {
+            if (region->sample != nullptr)
+                samples.add(region->sample);
+        }
+    }
+    Array<int> sampleIndexes;
+    sampleIndexes.insertMultiple(0, -1, samples.size());
+    for (SharedResourcesSF2::SampleLookup::Iterator i(resources.getSamplesByIndex()); i.next();)
+    {
+        const int position = samples.indexOf(i.getValue());
+        if (position >= 0)
+            sampleIndexes.set(position, i.getKey());
+    }
+
+    // Decoded samples are cached, unless loaded on demand
+    Array<const AudioSampleBuffer*> buffers;
+    const int sharedFrames = (sampleData != nullptr) ? sampleData->getNumSamples() : 0;
+    int numFrames = sharedFrames;
+    for (int i = 0; i < samples.size(); ++i)
+    {
+        const int index = sampleIndexes[i];
+        const AudioSampleBuffer *buffer = nullptr;
+        if (index >= 0 && resources.isCompressed(index) && storage_ != sf2StoreLazy)
+            buffer = samples[i]->getBuffer();
+        if (buffer != nullptr && static_cast<int64>(numFrames) + buffer->getNumSamples() > std::numeric_limits<int>::max())
+            buffer = nullptr;
+        buffers.add(buffer);
+        if (buffer != nullptr)
+            numFrames += buffer->getNumSamples();
+    }
+
+    MemoryOutputStream out;
+    out.writeInt(magic);
+    out.writeInt(version);
+    out.writeInt(static_cast<int>(sizeof(Region)));
+    out.writeInt(static_cast<int>(storage_));
+    out.writeInt64(source_.getSize());
+    out.writeInt64(source_.getLastModificationTime().toMilliseconds());
+    out.writeInt64(0); // sample data offset, set below
+    out.writeInt(numFrames);
+    out.writeInt(sharedFrames);
+    out.writeString(source_.getFullPathName());
+
+    out.writeInt(errors.size());
+    for (const String &error : errors)
+    {
+        out.writeString(error);
+    }
+
+    out.writeInt(samples.size());
+    int64 firstFrame = sharedFrames;
+    for (int i = 0; i < samples.size(); ++i)
+    {
+        Sample *sample = samples[i];
+        const int index = sampleIndexes[i];
+        const int sampleFrames = (buffers[i] != nullptr) ? buffers[i]->getNumSamples() : 0;
+        out.writeInt(index);
+        out.writeInt((index >= 0 && resources.isCompressed(index)) ? 1 : 0);
+        out.writeDouble(sample->getSampleRate());
+        out.writeInt64(sample->getSourceRange().getStart());
+        out.writeInt64(sample->getSourceRange().getEnd());
+        out.writeString(sample->name);
+        out.writeInt64(firstFrame);
+        out.writeInt(sampleFrames);
+        firstFrame += sampleFrames;
+    }
+
+    out.writeInt(resources.getPresets().size());
+    for (HashMap<int, Preset*>::Iterator i(resources.getPresets()); i.next();)
+    {
+        Preset *preset = i.getValue();
+        out.writeInt(preset->selection.bank);
+        out.writeInt(preset->selection.program);
+        out.writeString(preset->getName());
+        out.writeInt(preset->regions.size());
+        for (Region *region : preset->regions)
+        {
+            out.writeInt((region->sample != nullptr) ? samples.indexOf(region->sample) : -1);
+            out.write(region, sizeof(Region));
+        }
+    }
+
+    if (numFrames > 0)
+    {
+        // Aligned, so the mapped floats can be processed like any buffer
+        while (out.getDataSize() % sampleDataAlignment != 0)
+            out.writeByte(0);
+        const int64 sampleDataOffset = static_cast<int64>(out.getDataSize());
+        out.setPosition(sampleDataOffsetPosition);
+        out.writeInt64(sampleDataOffset);
+    }
+
+    // Written next to the cache file and then moved, replacing a previous one
+    TemporaryFile temp (file_);
+    {
+        FileOutputStream stream (temp.getFile());
+        if (!stream.openedOk())
+            return false;
+
+        bool ok = stream.write(out.getData(), out.getDataSize());
+        if (ok && sampleData != nullptr)
+            ok = stream.write(sampleData->getReadPointer(0), sharedFrames * sizeof(float));
+        for (const AudioSampleBuffer *buffer : buffers)
+        {
+            if (ok && buffer != nullptr)
+                ok = stream.write(buffer->getReadPointer(0), buffer->getNumSamples() * sizeof(float));
+        }
+        stream.flush();
+        if (!ok || stream.getStatus().failed())
+            return false;
+    }
+    return temp.overwriteTargetFileWithTemporary();
+}
@@ -0,0 +1,77 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZBANKCACHE_H_INCLUDED
+#define SFZBANKCACHE_H_INCLUDED
+
+#include "SFZSharedResources.h"
+
+namespace sfzero
+{
+    /** A compiled cache of a SF2 file, so loading it again needs no parsing or conversion.
+
+        The cache file holds the presets with their regions as binary records, and with
+        sf2StoreFloat the sample data converted to float. Decoded compressed samples of
+        SF3 files are kept as well, unless loaded on demand. On a warm start, the file is
+        memory mapped: regions are copied from it as they are, and samples play from the
+        mapped data directly. A cache is keyed by path, size and modification time of the
+        SF2 file, and by the storage it was compiled for. Stale caches are ignored and
+        rewritten after the SF2 file was loaded.
+
+        Used by SharedResourcesSF2, see SharedResources::setBankCacheDirectory().
+     */
+
+    class BankCache
+    {
+    public:
+        BankCache (const juce::File &directory, const juce::File &source, SF2SampleStorage storage);
+        ~BankCache();
+
+        /** Maps the cache file and adds its presets to resources, with the decoded
+            samples that were cached. Returns false without adding any if the cache is
+            missing, stale or broken. */
+        bool readPresets (SharedResourcesSF2 &resources, juce::StringArray &errors);
+
+        /** A buffer referring to the shared sample data in the mapped file, or nullptr if
+            not cached. Valid as long as the cache exists. */
+        juce::AudioSampleBuffer *createSampleBuffer();
+
+        /** True if the presets and all sample data to be cached were read from the cache */
+        bool isComplete() const;
+
+        /** Compiles the presets of resources, the shared sampleData if not nullptr, and
+            decoded samples into the cache file. The file is replaced at once when done,
+            so other processes never read a partial cache. */
+        bool write (SharedResourcesSF2 &resources, const juce::StringArray &errors,
+                    const juce::AudioSampleBuffer *sampleData);
+
+        /** The mapped cache file, or nullptr */
+        juce::MemoryMappedFile *getMappedFile() { return mappedFile_.get(); }
+
+    private:
+        enum { magic = 0x435a4653, version = 3, sampleDataAlignment = 64 };
+
+        juce::AudioSampleBuffer *referToSampleData (juce::int64 frame, int numFrames);
+
+        juce::File file_, source_;
+        SF2SampleStorage storage_;
+        std::unique_ptr<juce::MemoryMappedFile> mappedFile_;
+        bool presetsRead_, complete_;
+        juce::int64 sampleDataOffset_;
+        int sharedFrames_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BankCache)
+    };
+}
+
+#endif // SFZBANKCACHE_H_INCLUDED
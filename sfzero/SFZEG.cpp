@@ -237,3 +237,96 @@ void EG::startRelease()
 }
 
 
+
+int EG::renderBlock (float *gains, int numSamples)
+{
+    int done = 0;
+    while (done < numSamples)
+    {
+        const int remaining = numSamples - done;
+        
+        if (segment_ == Done)
+        {
+            juce::FloatVectorOperations::clear(gains + done, remaining);
+            return done;
+        }
+        if (segment_ == Sustain)
+        {
+            // Lasts until noteOff(), so don't count down
+            renderSegment(gains + done, remaining);
+            return numSamples;
+        }
+        if (samplesUntilNextSegment_ < 0)
+        {
+            nextSegment();
+            continue;
+        }
+        
+        // Samples up to and including the one that ends the segment
+        const int length = (samplesUntilNextSegment_ < remaining) ? samplesUntilNextSegment_ + 1 : remaining;
+        renderSegment(gains + done, length);
+        samplesUntilNextSegment_ -= length;
+        done += length;
+        
+        if (samplesUntilNextSegment_ < 0)
+        {
+            nextSegment();
+        }
+    }
+    return numSamples;
+}
+
+void EG::renderSegment (float *gains, int numSamples)
+{
+    typedef FloatVector V;
+    const int width = V::width;
+    
+    // Level of each lane relative to the first lane, and the factor/offset
+    // to advance the level by a whole vector.
+    alignas(32) float lanes[width];
+    float step;
+    if (segmentIsExponential_)
+    {
+        float f = 1.0f;
+        for (int k = 0; k < width; ++k)
+        {
+            lanes[k] = f;
+            f *= slope_;
+        }
+        step = f;
+    }
+    else
+    {
+        for (int k = 0; k < width; ++k)
+            lanes[k] = k * slope_;
+        step = width * slope_;
+    }
+    const V::Type offsets = V::load(lanes);
+    
+    if (segmentIsExponential_)
+    {
+        for (; numSamples >= width; numSamples -= width, gains += width)
+        {
+            V::store(gains, V::mul(V::set1(level_), offsets));
+            level_ *= step;
+        }
+        for (; numSamples > 0; --numSamples)
+        {
+            *gains++ = level_;
+            level_ *= slope_;
+        }
+    }
+    else
+    {
+        for (; numSamples >= width; numSamples -= width, gains += width)
+        {
+            V::store(gains, V::add(V::set1(level_), offsets));
+            level_ += step;
+        }
+        for (; numSamples > 0; --numSamples)
+        {
+            *gains++ = level_;
+            level_ += slope_;
+        }
+    }
+}
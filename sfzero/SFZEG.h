@@ -15,6 +15,7 @@
 #define SFZEG_H_INCLUDED
 
 #include "SFZRegion.h"
+#include "SFZSIMD.h"
 
 namespace sfzero
 {
@@ -41,6 +42,15 @@ namespace sfzero
         bool    getSegmentIsExponential() const { return segmentIsExponential_; }
         void    setSegmentIsExponential(bool v) { segmentIsExponential_ = v; }
         
+        /** Writes the gains of the next numSamples samples and advances the EG, handling
+            segment transitions internally. Returns the number of samples before the EG
+            is done; gains after that are zero.
+         
+            Lanes compute their level from the start of each vector rather than by repeated
+            addition or multiplication, so gains differ from per-sample stepping by rounding
+            only: less than 1e-4 for segments of up to 4096 samples. */
+        int     renderBlock (float *gains, int numSamples);
+        
     private:
         enum Segment
         {
@@ -59,6 +69,7 @@ namespace sfzero
         void startDecay();
         void startSustain();
         void startRelease();
+        void renderSegment (float *gains, int numSamples);
         
         Segment         segment_;
         EGParameters    parameters_;
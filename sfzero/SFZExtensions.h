@@ -15,6 +15,7 @@
 #define SFZEXTENSIONS_H_INCLUDED
 
 #include "SFZCommon.h"
+#include "SFZRegionTable.h"
 
 namespace sfzero {
     
@@ -59,7 +60,7 @@ namespace sfzero {
     {
     public:
         virtual ~Preset() {}
-        Preset (const juce::String nameIn, int bankIn, int presetIn) : selection(bankIn, presetIn, nameIn) {}
+        Preset (const juce::String nameIn, int bankIn, int presetIn) : selection(bankIn, presetIn, nameIn), numSelections(0) {}
         
         int index() const { return selection.index(); }
         juce::String& getName () { return selection.name; }
@@ -67,8 +68,15 @@ namespace sfzero {
         
         void addRegion (Region *region) { regions.add(region); }
         
+        /** Builds the table selected by SF2Sound::setProgramSelection(). Call after adding all regions. */
+        void buildRegionTable () { regionTable.reset(new RegionTable(regions.getRawDataPointer(), regions.size())); }
+        RegionTable *getRegionTable () { return regionTable.get(); }
+        
         ProgramSelection selection;
         juce::OwnedArray<Region> regions;
+        std::unique_ptr<RegionTable> regionTable;
+        // Sounds selecting the preset, whose samples are loaded on demand (see sf2StoreLazy)
+        juce::Atomic<int> numSelections;
         
         JUCE_LEAK_DETECTOR (Preset)
     };
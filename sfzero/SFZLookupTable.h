@@ -0,0 +1,196 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZLOOKUPTABLE_H_INCLUDED
+#define SFZLOOKUPTABLE_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+    /** A hash map of pointers whose lookups don't lock, so they never wait for a sample
+        file being loaded meanwhile. Used by the shared resources.
+
+        Writers are serialized by a lock. Keys are never removed: removing a key sets its
+        value to nullptr, and setting it again reuses the entry. When half the slots are
+        used, they are copied to a table of twice the size, which replaces the previous one
+        atomically. Readers may still probe previous tables, so these are kept until the
+        LookupTable is deleted; together, they are smaller than the current one.
+     */
+
+    template <typename KeyType, typename ValueType, class HashFunctionType = juce::DefaultHashFunctions>
+    class LookupTable
+    {
+    public:
+
+        LookupTable() : table_ (new Table (initialSize)), size_ (0), numEntries_ (0)
+        {
+            tables_.add(table_.get());
+        }
+
+        ~LookupTable()
+        {
+            Table *table = table_.get();
+            for (int i = 0; i < table->size; ++i)
+                delete table->slots[i].get();
+        }
+
+        /** The value of key, or nullptr. Lock-free. */
+        ValueType operator[] (const KeyType &key) const
+        {
+            Entry *entry = find(table_.get(), key);
+            return entry != nullptr ? entry->value.get() : nullptr;
+        }
+
+        /** Sets the value of key, replacing any previous one */
+        void set (const KeyType &key, ValueType value)
+        {
+            const juce::ScopedLock sl (lock_);
+            setValue(getEntry(key), value);
+        }
+
+        /** Sets the value of key, unless it has one already. Returns the value of key then. */
+        ValueType setIfAbsent (const KeyType &key, ValueType value)
+        {
+            const juce::ScopedLock sl (lock_);
+            Entry *entry = getEntry(key);
+            if (entry->value.get() == nullptr)
+                setValue(entry, value);
+            return entry->value.get();
+        }
+
+        void remove (const KeyType &key)
+        {
+            const juce::ScopedLock sl (lock_);
+            if (Entry *entry = find(table_.get(), key))
+                setValue(entry, nullptr);
+        }
+
+        /** Number of keys with a value, as far as set before */
+        int size() const { return size_.get(); }
+
+        /** Visits the keys with a value, like juce::HashMap::Iterator. Keys set while
+            iterating may be missed. */
+        class Iterator
+        {
+        public:
+            explicit Iterator (const LookupTable &lookupTable) :
+                table_ (lookupTable.table_.get()), index_ (-1), entry_ (nullptr)
+            {}
+
+            bool next()
+            {
+                while (++index_ < table_->size)
+                {
+                    entry_ = table_->slots[index_].get();
+                    if (entry_ != nullptr && entry_->value.get() != nullptr)
+                        return true;
+                }
+                entry_ = nullptr;
+                return false;
+            }
+
+            KeyType getKey() const { return entry_->key; }
+            ValueType getValue() const { return entry_->value.get(); }
+
+        private:
+            const typename LookupTable::Table *table_;
+            int index_;
+            typename LookupTable::Entry *entry_;
+        };
+
+    private:
+
+        enum { initialSize = 64 };
+
+        struct Entry
+        {
+            Entry (const KeyType &keyIn) : key (keyIn), value (nullptr) {}
+
+            const KeyType key;
+            juce::Atomic<ValueType> value;
+        };
+
+        // Open addressing with linear probing. Slots are set once, never cleared.
+        struct Table
+        {
+            explicit Table (int sizeIn) : size (sizeIn), slots (new juce::Atomic<Entry*>[sizeIn]) {}
+
+            const int size;
+            std::unique_ptr<juce::Atomic<Entry*>[]> slots;
+        };
+
+        Entry *find (const Table *table, const KeyType &key) const
+        {
+            for (int i = hash_.generateHash(key, table->size);; i = (i + 1) % table->size)
+            {
+                Entry *entry = table->slots[i].get();
+                if (entry == nullptr || entry->key == key)
+                    return entry;
+            }
+        }
+
+        Entry *getEntry (const KeyType &key)
+        {
+            Table *table = table_.get();
+            if (Entry *entry = find(table, key))
+                return entry;
+
+            if (2 * (numEntries_ + 1) > table->size)
+            {
+                // The new table is complete before it is published
+                Table *larger = new Table (2 * table->size);
+                for (int i = 0; i < table->size; ++i)
+                {
+                    if (Entry *entry = table->slots[i].get())
+                        insert(larger, entry);
+                }
+                tables_.add(larger);
+                table_ = larger;
+                table = larger;
+            }
+            Entry *entry = new Entry (key);
+            insert(table, entry);
+            ++numEntries_;
+            return entry;
+        }
+
+        void setValue (Entry *entry, ValueType value)
+        {
+            if (entry->value.get() == nullptr && value != nullptr)
+                ++size_;
+            else if (entry->value.get() != nullptr && value == nullptr)
+                --size_;
+            entry->value = value;
+        }
+
+        void insert (Table *table, Entry *entry)
+        {
+            int i = hash_.generateHash(entry->key, table->size);
+            while (table->slots[i].get() != nullptr)
+                i = (i + 1) % table->size;
+            table->slots[i] = entry;
+        }
+
+        HashFunctionType hash_;
+        juce::CriticalSection lock_;
+        juce::Atomic<Table*> table_;
+        juce::OwnedArray<Table> tables_;
+        juce::Atomic<int> size_;
+        int numEntries_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LookupTable)
+    };
+}
+
+#endif // SFZLOOKUPTABLE_H_INCLUDED
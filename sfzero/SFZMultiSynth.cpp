@@ -0,0 +1,303 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZMultiSynth.h"
+#include "SFZReleasePool.h"
+#include "SFZSound.h"
+#include "SFZVoice.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+MultiSynth::MultiSynth () :
+    SynthBase(),
+    channelMix_(2 * numChannels, mixBlockSize)
+{
+    for (int i = 0; i < numChannels; ++i)
+    {
+        channels_.add(new Channel(i + 1, *this));
+    }
+}
+
+MultiSynth::~MultiSynth ()
+{
+    renderPool_ = nullptr;
+    sounds.clear();
+}
+
+Channel* MultiSynth::getChannel (int midiChannel)
+{
+    if (isPositiveAndBelow(midiChannel - 1, static_cast<int>(numChannels)))
+        return channels_.getUnchecked(midiChannel - 1);
+    else
+        return nullptr;
+}
+
+void MultiSynth::swapSound (int midiChannel, const SynthesiserSound::Ptr &newSound)
+{
+    Channel *channel = getChannel(midiChannel);
+    jassert (channel != nullptr);
+    if (channel == nullptr)
+        return;
+
+    // The previous sound is taken under the lock, so the audio thread is done with
+    // it, and deleted in the background rather than here under the lock
+    SynthesiserSound::Ptr oldSound;
+    {
+        ScopedLock locker (lock);
+
+        oldSound = channel->getSound();
+        allNotesOff(midiChannel, false);
+        channel->setSound(newSound);
+    }
+    ReleasePool::getInstance()->add(oldSound.get());
+}
+
+Sound* MultiSynth::getSound (int midiChannel)
+{
+    Channel *channel = getChannel(midiChannel);
+    return channel ? channel->getSound() : nullptr;
+}
+
+void MultiSynth::setProgramSelection (int midiChannel, const ProgramSelection& selection)
+{
+    Channel *channel = getChannel(midiChannel);
+    jassert (channel != nullptr);
+    if (channel == nullptr)
+        return;
+
+    ScopedLock locker (lock);
+
+    selectProgram(*channel, selection);
+}
+
+ProgramSelection& MultiSynth::getProgramSelection (int midiChannel)
+{
+    jassert (getChannel(midiChannel) != nullptr);
+
+    ScopedLock locker (lock);
+
+    return getChannel(midiChannel)->getProgramSelection();
+}
+
+int MultiSynth::getProgramCount (int midiChannel, int bank)
+{
+    Channel *channel = getChannel(midiChannel);
+    if (channel == nullptr)
+        return 1;
+
+    ScopedLock locker (lock);
+
+    return channel->getProgramCount(bank);
+}
+
+String MultiSynth::getProgramName (int midiChannel, const ProgramSelection& selection)
+{
+    Channel *channel = getChannel(midiChannel);
+    if (channel == nullptr)
+        return String();
+
+    ScopedLock locker (lock);
+
+    return channel->getProgramName(selection);
+}
+
+ProgramList* MultiSynth::getProgramList (int midiChannel)
+{
+    Channel *channel = getChannel(midiChannel);
+    if (channel == nullptr)
+        return new ProgramList();
+
+    ScopedLock locker (lock);
+
+    return channel->getProgramList();
+}
+
+float MultiSynth::getParameter (int midiChannel, int index)
+{
+    Channel *channel = getChannel(midiChannel);
+    return channel ? channel->getParameter(index) : 0;
+}
+
+void MultiSynth::setParameter (int midiChannel, int index, float newValue)
+{
+    Channel *channel = getChannel(midiChannel);
+    if (channel)
+        channel->setParameter(index, newValue);
+}
+
+bool MultiSynth::usesEffectsUnit (int midiChannel)
+{
+    Channel *channel = getChannel(midiChannel);
+    return channel && channel->usesEffectsUnit();
+}
+
+bool MultiSynth::hasProgramSelectionChanged (int midiChannel, bool reset)
+{
+    Channel *channel = getChannel(midiChannel);
+    return channel && channel->hasProgramSelectionChanged(reset);
+}
+
+class MultiSynth::RenderJob : public RenderPool::Job
+{
+public:
+    RenderJob (MultiSynth &synth, const int *channelIndexes, int blockSize) :
+        synth_ (synth), channelIndexes_ (channelIndexes), blockSize_ (blockSize)
+    {}
+
+    void runTask (int index) override
+    {
+        synth_.renderChannel(channelIndexes_[index], blockSize_);
+    }
+
+private:
+    MultiSynth &synth_;
+    const int *channelIndexes_;
+    const int blockSize_;
+};
+
+void MultiSynth::setRenderThreads (int numWorkers)
+{
+    std::unique_ptr<RenderPool> pool;
+    if (numWorkers > 0)
+        pool.reset(new RenderPool(numWorkers));
+
+    {
+        ScopedLock locker (lock);
+        renderPool_.swap(pool);
+    }
+    // The previous pool, if any, stops its threads here, outside of the lock
+}
+
+int MultiSynth::getRenderThreads()
+{
+    ScopedLock locker (lock);
+
+    return renderPool_ ? renderPool_->getNumWorkers() : 0;
+}
+
+void MultiSynth::renderChannel (int index, int blockSize)
+{
+    const int midiChannel = index + 1;
+
+    channelMix_.clear(2 * index, 0, blockSize);
+    channelMix_.clear(2 * index + 1, 0, blockSize);
+    float *pair[2] = { channelMix_.getWritePointer(2 * index), channelMix_.getWritePointer(2 * index + 1) };
+    AudioSampleBuffer channelBuffer (pair, 2, blockSize);
+
+    for (Voice *voice : activeVoices_)
+    {
+        // Other channels' voices may be rendering on other threads, check their channel only
+        if (voice->getMidiChannel() != midiChannel || voice->getCurrentlyPlayingNote() < 0)
+            continue;
+
+        voice->renderNextBlock(channelBuffer, 0, blockSize);
+    }
+}
+
+void MultiSynth::renderVoices (AudioSampleBuffer &outputAudio, int startSample, int numSamples)
+{
+    jassert(outputAudio.getNumChannels() >= 2);
+    const bool hasSendOutputs = outputAudio.getNumChannels() >= 4;
+
+    while (numSamples > 0)
+    {
+        const int blockSize = jmin(numSamples, static_cast<int>(mixBlockSize));
+
+        // Channels with sounding voices
+        juce::uint32 usedChannels = 0;
+        int channelIndexes[numChannels];
+        int numUsedChannels = 0;
+        for (Voice *voice : activeVoices_)
+        {
+            if (voice->getCurrentlyPlayingNote() < 0)
+                continue;
+
+            const int index = voice->getMidiChannel() - 1;
+            jassert (isPositiveAndBelow(index, static_cast<int>(numChannels)));
+            const juce::uint32 bit = 1u << index;
+            if ((usedChannels & bit) == 0)
+            {
+                usedChannels |= bit;
+                channelIndexes[numUsedChannels++] = index;
+            }
+        }
+
+        if (renderPool_ && numUsedChannels > 1)
+        {
+            RenderJob job (*this, channelIndexes, blockSize);
+            renderPool_->run(job, numUsedChannels);
+        }
+        else
+        {
+            for (int i = 0; i < numUsedChannels; ++i)
+                renderChannel(channelIndexes[i], blockSize);
+        }
+
+        // Master Volume & Pan, Sidechain: Reverb send outputs
+        for (int index = 0; index < numChannels; ++index)
+        {
+            if ((usedChannels & (1u << index)) == 0)
+                continue;
+
+            Channel *channel = channels_.getUnchecked(index);
+            const float gainL = channel->getGainLeft();
+            const float gainR = channel->getGainRight();
+            outputAudio.addFrom(0, startSample, channelMix_, 2 * index,     0, blockSize, gainL);
+            outputAudio.addFrom(1, startSample, channelMix_, 2 * index + 1, 0, blockSize, gainR);
+
+            const float send = channel->getSendLevel();
+            if (hasSendOutputs && send > 0)
+            {
+                outputAudio.addFrom(2, startSample, channelMix_, 2 * index,     0, blockSize, gainL * send);
+                outputAudio.addFrom(3, startSample, channelMix_, 2 * index + 1, 0, blockSize, gainR * send);
+            }
+        }
+
+        startSample += blockSize;
+        numSamples -= blockSize;
+    }
+    releaseFinishedVoices();
+}
+
+std::unique_ptr<XmlElement> MultiSynth::getStateXML ()
+{
+    auto xml = std::make_unique<XmlElement> ("MULTISYNTH");
+    xml->setAttribute("interpolation", interpolation_.get());
+    for (Channel *channel : channels_)
+    {
+        xml->addChildElement(channel->getStateXML().release());
+    }
+    return xml;
+}
+
+bool MultiSynth::setStateXML (const XmlElement* xml)
+{
+    if ((xml == nullptr) || !xml->hasTagName ("MULTISYNTH"))
+        return false;
+
+    for (int i = 0; i < xml->getNumChildElements(); ++i)
+    {
+        const XmlElement *child = xml->getChildElement(i);
+        Channel *channel = getChannel(child->getIntAttribute("slot", -1) + 1);
+        if (channel)
+            channel->setStateXML(child);
+    }
+
+    const int interpolation = xml->getIntAttribute("interpolation", interpolateLinear);
+    if (interpolation >= 0 && interpolation < numInterpolationQualities)
+        setInterpolationQuality(static_cast<InterpolationQuality>(interpolation));
+
+    return true;
+}
@@ -0,0 +1,105 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZMULTISYNTH_H_INCLUDED
+#define SFZMULTISYNTH_H_INCLUDED
+
+#include "SFZSynth.h"
+#include "SFZRenderPool.h"
+
+namespace sfzero
+{
+    /*********************************************************************************
+     *    MultiSynth
+     *********************************************************************************/
+
+    /** Plays all 16 MIDI channels in one engine, as an alternative to one Synth per channel.
+
+        MIDI is dispatched to the channels by a single pass of juce::Synthesiser over the
+        incoming buffer. All channels draw from one pool of voices, so a busy channel can
+        use voices an idle one doesn't need, and stealing picks the best candidate across
+        all channels. Voices are mixed per channel with its volume, pan and reverb send
+        into one output: channels 0/1 main, 2/3 (if present) reverb send.
+
+        Channel-related methods take the MIDI channel (1...16).
+
+        Optionally, channels are rendered in parallel by a RenderPool, see setRenderThreads().
+        Each channel's voices are summed by one thread in the same order as without the
+        pool, and channels are mixed in channel order, so the output is the same either way.
+     */
+
+    class MultiSynth : public SynthBase
+    {
+    public:
+
+        enum { numChannels = 16 };
+
+        MultiSynth ();
+        virtual ~MultiSynth();
+
+        // Safely swap a channel's sound under lock
+        void swapSound (int midiChannel, const juce::SynthesiserSound::Ptr &newSound);
+
+        // Safely select and query presets under lock
+        int               getProgramCount (int midiChannel, int bank);
+        juce::String      getProgramName (int midiChannel, const ProgramSelection& selection);
+        ProgramSelection& getProgramSelection (int midiChannel);
+        void              setProgramSelection (int midiChannel, const ProgramSelection& selection);
+        ProgramList*      getProgramList (int midiChannel);
+
+        /** Renders channels on numWorkers threads in addition to the audio thread, or all
+            on the audio thread if 0 (default). Starts or stops threads, so call this from
+            a non-realtime thread. */
+        void setRenderThreads (int numWorkers);
+        int  getRenderThreads();
+
+        // Mixes voices per channel, with master volume, pan & reverb send
+        void renderVoices (juce::AudioSampleBuffer &outputAudio, int startSample, int numSamples) override;
+
+        // Control volume, pan & reverb send, range 0...1 (see: SynthBase::Parameters)
+        float getParameter (int midiChannel, int index);
+        void  setParameter (int midiChannel, int index, float newValue);
+
+        std::unique_ptr<juce::XmlElement> getStateXML ();
+        bool setStateXML (const juce::XmlElement* xml);
+
+        /** Allow my ChangeListener to distinguish between program selection or other parameter changes */
+        bool hasProgramSelectionChanged (int midiChannel, bool reset = true);
+
+        bool usesEffectsUnit (int midiChannel);
+
+        /** Return the sound (soundbank actually) of a channel, typecast to sfzero::Sound */
+        Sound* getSound (int midiChannel);
+
+    protected:
+        Channel* getChannel (int midiChannel) override;
+
+    private:
+
+        enum { mixBlockSize = 256 };
+
+        class RenderJob;
+
+        /** Sums the voices of a channel (0...15) into its pair in channelMix_ */
+        void renderChannel (int index, int blockSize);
+
+        juce::OwnedArray<Channel> channels_;
+        // Stereo pair per channel, voices of a channel are summed here before mixing
+        juce::AudioSampleBuffer channelMix_;
+        std::unique_ptr<RenderPool> renderPool_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiSynth)
+    };
+}
+
+#endif // SFZMULTISYNTH_H_INCLUDED
@@ -81,6 +81,7 @@ namespace sfzero
         SamplePosition offset;
         SamplePosition end;
         bool negative_end;
+        bool end_from_sample_end;   // end is an offset to the sample's length (SF3, known after decoding)
         LoopMode loop_mode;
         SamplePosition loop_start, loop_end;
         int transpose;
@@ -0,0 +1,90 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZRegionTable.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+RegionTable::RegionTable ()
+{
+    zeromem(indexStart_, sizeof(indexStart_));
+}
+
+RegionTable::RegionTable (Region * const *regions, int numRegions)
+{
+    regions_.addArray(regions, numRegions);
+    // Count candidates per bucket first, then fill them in region order
+    int counts[numIndexBuckets] = {};
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (Region *region : regions_)
+        {
+            const int lokey = jmax(region->lokey, 0), hikey = jmin(region->hikey, 127);
+            const int lobucket = jmax(region->lovel, 0) >> velocityBucketBits;
+            const int hibucket = jmin(region->hivel, 127) >> velocityBucketBits;
+
+            for (int key = lokey; key <= hikey; ++key)
+            {
+                for (int v = lobucket; v <= hibucket; ++v)
+                {
+                    const int bucket = key * numVelocityBuckets + v;
+                    if (pass == 0)
+                        ++counts[bucket];
+                    else
+                        index_.set(indexStart_[bucket] + counts[bucket]++, region);
+                }
+            }
+        }
+        if (pass == 0)
+        {
+            indexStart_[0] = 0;
+            for (int bucket = 0; bucket < numIndexBuckets; ++bucket)
+            {
+                indexStart_[bucket + 1] = indexStart_[bucket] + counts[bucket];
+                counts[bucket] = 0;
+            }
+            index_.insertMultiple(0, nullptr, indexStart_[numIndexBuckets]);
+        }
+    }
+}
+
+Region * const *RegionTable::getCandidates (int note, int velocity, int &numCandidates) const
+{
+    if (!isPositiveAndBelow(note, 128) || !isPositiveAndBelow(velocity, 128))
+    {
+        // Out of the index range
+        numCandidates = regions_.size();
+        return regions_.begin();
+    }
+    const int bucket = note * numVelocityBuckets + (velocity >> velocityBucketBits);
+    numCandidates = indexStart_[bucket + 1] - indexStart_[bucket];
+    return index_.begin() + indexStart_[bucket];
+}
+
+Region *RegionTable::getRegionFor (int note, int velocity, Region::Trigger trigger) const
+{
+    int numCandidates;
+    Region * const *candidates = getCandidates(note, velocity, numCandidates);
+
+    for (int i = 0; i < numCandidates; ++i)
+    {
+        Region *region = candidates[i];
+        if (region->matches(note, velocity, trigger))
+        {
+            return region;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,55 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZREGIONTABLE_H_INCLUDED
+#define SFZREGIONTABLE_H_INCLUDED
+
+#include "SFZRegion.h"
+
+namespace sfzero
+{
+    /** The regions of a program, with a lookup by key and velocity bucket.
+
+        Built once on a non-realtime thread and never changed afterwards, so the audio
+        thread can switch programs by swapping a pointer to a table. Doesn't own the regions.
+     */
+
+    class RegionTable
+    {
+    public:
+
+        RegionTable ();
+        RegionTable (Region * const *regions, int numRegions);
+
+        int     size() const { return regions_.size(); }
+        Region *operator[] (int index) const { return regions_[index]; }
+
+        /** Regions whose key and velocity ranges may include note and velocity, in region
+            order. These still need to be checked with Region::matches(). */
+        Region * const *getCandidates (int note, int velocity, int &numCandidates) const;
+        Region *getRegionFor (int note, int velocity, Region::Trigger trigger) const;
+
+    private:
+
+        // Candidate regions per key and velocity bucket, concatenated
+        enum { velocityBucketBits = 4, numVelocityBuckets = 128 >> velocityBucketBits, numIndexBuckets = 128 * numVelocityBuckets };
+
+        juce::Array<Region *> regions_;
+        juce::Array<Region *> index_;
+        int indexStart_[numIndexBuckets + 1];
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RegionTable)
+    };
+}
+
+#endif // SFZREGIONTABLE_H_INCLUDED
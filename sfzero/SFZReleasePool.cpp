@@ -0,0 +1,74 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZReleasePool.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+juce_ImplementSingleton (sfzero::ReleasePool)
+
+ReleasePool::ReleasePool () :
+    Thread ("SFZero release pool")
+{
+}
+
+ReleasePool::~ReleasePool ()
+{
+    stopThread(4 * releaseInterval);
+    objects_.clear();
+    clearSingletonInstance();
+}
+
+void ReleasePool::add (ReferenceCountedObject *object)
+{
+    if (object == nullptr)
+        return;
+
+    ScopedLock locker (lock_);
+
+    // A sound swapped out again is held once, so it's released once only the pool has it
+    objects_.addIfNotAlreadyThere(object);
+    if (!isThreadRunning())
+    {
+        startThread();
+    }
+}
+
+void ReleasePool::releaseUnused ()
+{
+    // Objects are released when "unused" goes out of scope, after the lock is exited,
+    // so add() doesn't wait for the deletion of large objects
+    ReferenceCountedArray<ReferenceCountedObject> unused;
+    {
+        ScopedLock locker (lock_);
+        for (int i = objects_.size(); --i >= 0;)
+        {
+            if (objects_.getObjectPointer(i)->getReferenceCount() == 1)
+            {
+                unused.add(objects_.getObjectPointer(i));
+                objects_.remove(i);
+            }
+        }
+    }
+}
+
+void ReleasePool::run ()
+{
+    while (!threadShouldExit())
+    {
+        wait(releaseInterval);
+        releaseUnused();
+    }
+}
@@ -0,0 +1,57 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZRELEASEPOOL_H_INCLUDED
+#define SFZRELEASEPOOL_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+    /** A global singleton that deletes objects on a background thread.
+
+        Deleting a Sound can free its shared sample data, possibly hundreds of megabytes.
+        A Synth swapping sounds hands the previous one to this pool first. The pool holds
+        on to it until nothing else references it, e.g. a voice still playing or another
+        Synth, and then releases it on its own thread. So the last reference is never
+        dropped on the audio thread, or while holding a Synth's lock.
+     */
+
+    class ReleasePool : private juce::Thread
+    {
+    public:
+        ReleasePool();
+        ~ReleasePool();
+
+        juce_DeclareSingleton (ReleasePool, false);
+
+        /** Keeps a reference to the object until it's the only one left. Call before
+            dropping a reference that may be the last one. Not realtime-safe. */
+        void add (juce::ReferenceCountedObject *object);
+
+        /** Releases the objects referenced by the pool only, now and on the calling thread */
+        void releaseUnused ();
+
+    private:
+        enum { releaseInterval = 1000 }; // ms
+
+        void run() override;
+
+        juce::CriticalSection lock_;
+        juce::ReferenceCountedArray<juce::ReferenceCountedObject> objects_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReleasePool)
+    };
+}
+
+#endif // SFZRELEASEPOOL_H_INCLUDED
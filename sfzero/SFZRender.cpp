@@ -0,0 +1,369 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZRender.h"
+
+using namespace sfzero;
+
+/*********************************************************************************
+ *    Interpolators
+ *********************************************************************************/
+
+namespace
+{
+    typedef FloatVector V;
+    
+    /** Gathers numTaps neighbors of each lane's sample, tap-major, i.e. taps[t * width + k] */
+    template <int tapsBefore, int numTaps, typename SampleType>
+    inline void gatherLanes (const SampleType *in, SamplePhase phase, SamplePhase increment, float *taps, float *alphas)
+    {
+        for (int k = 0; k < V::width; ++k)
+        {
+            const SamplePhase lanePhase = phase + k * increment;
+            const SampleType *x = in + samplePhaseIndex(lanePhase) - tapsBefore;
+            for (int t = 0; t < numTaps; ++t)
+                taps[t * V::width + k] = static_cast<float>(x[t]);
+            alphas[k] = samplePhaseFraction(lanePhase);
+        }
+    }
+    
+    struct LinearInterpolator
+    {
+        enum { tapsBefore = 0, tapsAfter = 1 };
+        
+        explicit LinearInterpolator (SamplePhase) {}
+        
+        template <typename SampleType>
+        float interpolate (const SampleType *x, SamplePhase phase) const
+        {
+            const float alpha = samplePhaseFraction(phase);
+            return static_cast<float>(x[0]) * (1.0f - alpha) + static_cast<float>(x[1]) * alpha;
+        }
+        
+        template <typename SampleType>
+        void interpolateLanes (const SampleType *in, SamplePhase phase, SamplePhase increment, float *out) const
+        {
+            alignas(32) float taps[2 * V::width], alphas[V::width];
+            gatherLanes<tapsBefore, 2>(in, phase, increment, taps, alphas);
+            
+            const V::Type alpha = V::load(alphas);
+            const V::Type alphaInv = V::sub(V::set1(1.0f), alpha);
+            V::store(out, V::add(V::mul(V::load(taps), alphaInv), V::mul(V::load(taps + V::width), alpha)));
+        }
+    };
+    
+    struct CubicInterpolator
+    {
+        enum { tapsBefore = 1, tapsAfter = 2 };
+        
+        explicit CubicInterpolator (SamplePhase) {}
+        
+        template <typename SampleType>
+        float interpolate (const SampleType *x, SamplePhase phase) const
+        {
+            // Catmull-Rom spline through x[-1] ... x[2]
+            const float t = samplePhaseFraction(phase);
+            const float xm1 = static_cast<float>(x[-1]), x0 = static_cast<float>(x[0]);
+            const float x1 = static_cast<float>(x[1]), x2 = static_cast<float>(x[2]);
+            const float c1 = 0.5f * (x1 - xm1);
+            const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+            const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+            return ((c3 * t + c2) * t + c1) * t + x0;
+        }
+        
+        template <typename SampleType>
+        void interpolateLanes (const SampleType *in, SamplePhase phase, SamplePhase increment, float *out) const
+        {
+            alignas(32) float taps[4 * V::width], alphas[V::width];
+            gatherLanes<tapsBefore, 4>(in, phase, increment, taps, alphas);
+            
+            const V::Type xm1 = V::load(taps);
+            const V::Type x0  = V::load(taps + V::width);
+            const V::Type x1  = V::load(taps + 2 * V::width);
+            const V::Type x2  = V::load(taps + 3 * V::width);
+            const V::Type t   = V::load(alphas);
+            
+            const V::Type c1 = V::mul(V::set1(0.5f), V::sub(x1, xm1));
+            const V::Type c2 = V::sub(V::add(V::sub(xm1, V::mul(V::set1(2.5f), x0)), V::mul(V::set1(2.0f), x1)),
+                                      V::mul(V::set1(0.5f), x2));
+            const V::Type c3 = V::add(V::mul(V::set1(0.5f), V::sub(x2, xm1)), V::mul(V::set1(1.5f), V::sub(x0, x1)));
+            V::store(out, V::add(V::mul(V::add(V::mul(V::add(V::mul(c3, t), c2), t), c1), t), x0));
+        }
+    };
+    
+    /** Polyphase coefficients of a Blackman-windowed sinc with numTaps taps.
+     
+        The table is 64-byte aligned and has one row per fractional phase plus one
+        extra, so coefficients can be interpolated linearly between neighboring phases. Each
+        band has its cutoff lowered for a range of pitch ratios, so transposing up
+        does not fold partials above the output Nyquist frequency back into the audio.
+     */
+    template <int numTaps>
+    struct SincTable
+    {
+        enum
+        {
+            tapsBefore = numTaps / 2 - 1,
+            phaseBits = 8,
+            numPhases = 1 << phaseBits,
+            numBands = 5
+        };
+        
+        SincTable()
+        {
+            const double bandRatios[numBands] = { 1.0, 1.5, 2.0, 3.0, 4.0 };
+            for (int band = 0; band < numBands; ++band)
+            {
+                const double cutoff = 0.9 / bandRatios[band];
+                for (int phase = 0; phase <= numPhases; ++phase)
+                {
+                    float *row = coefficients[band][phase];
+                    const double frac = static_cast<double>(phase) / numPhases;
+                    double sum = 0.0;
+                    for (int t = 0; t < numTaps; ++t)
+                    {
+                        const double d = (t - tapsBefore) - frac;
+                        const double a = juce::MathConstants<double>::pi * d;
+                        const double w = juce::MathConstants<double>::twoPi * d / numTaps;
+                        const double sinc = (d == 0.0) ? cutoff : sin(a * cutoff) / a;
+                        const double window = 0.42 + 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+                        const double c = (std::abs(d) < numTaps / 2.0) ? sinc * window : 0.0;
+                        row[t] = static_cast<float>(c);
+                        sum += c;
+                    }
+                    // Unity gain at DC
+                    for (int t = 0; t < numTaps; ++t)
+                        row[t] = static_cast<float>(row[t] / sum);
+                }
+            }
+        }
+        
+        const float (*bandFor (SamplePhase increment) const)[numTaps]
+        {
+            static const SamplePhase one = static_cast<SamplePhase>(1) << samplePhaseBits;
+            if (increment <= one)                       return coefficients[0];
+            if (increment <= one + one / 2)             return coefficients[1];
+            if (increment <= 2 * one)                   return coefficients[2];
+            if (increment <= 3 * one)                   return coefficients[3];
+            return coefficients[4];
+        }
+        
+        static const SincTable &get()
+        {
+            static const SincTable table;
+            return table;
+        }
+        
+        alignas(64) float coefficients[numBands][numPhases + 1][numTaps];
+    };
+    
+    template <int numTaps>
+    struct SincInterpolator
+    {
+        typedef SincTable<numTaps> Table;
+        enum { tapsBefore = Table::tapsBefore, tapsAfter = numTaps - 1 - tapsBefore };
+        
+        explicit SincInterpolator (SamplePhase increment) : rows(Table::get().bandFor(increment)) {}
+        
+        template <typename SampleType>
+        float interpolate (const SampleType *x, SamplePhase phase) const
+        {
+            const juce::uint32 frac = static_cast<juce::uint32>(phase & samplePhaseFractionMask);
+            const int shift = samplePhaseBits - Table::phaseBits;
+            const float *row0 = rows[frac >> shift];
+            const float *row1 = rows[(frac >> shift) + 1];
+            const V::Type f = V::set1(static_cast<float>(frac & ((1u << shift) - 1)) * (1.0f / (1u << shift)));
+            
+            x -= tapsBefore;
+            V::Type acc = V::set1(0.0f);
+            for (int t = 0; t < numTaps; t += V::width)
+            {
+                const V::Type c0 = V::load(row0 + t);
+                const V::Type c = V::add(c0, V::mul(V::sub(V::load(row1 + t), c0), f));
+                acc = V::add(acc, V::mul(c, V::load(x + t)));
+            }
+            return V::sum(acc);
+        }
+        
+        template <typename SampleType>
+        void interpolateLanes (const SampleType *in, SamplePhase phase, SamplePhase increment, float *out) const
+        {
+            // Vectorized across taps rather than frames
+            for (int k = 0; k < V::width; ++k)
+            {
+                const SamplePhase lanePhase = phase + k * increment;
+                out[k] = interpolate(in + samplePhaseIndex(lanePhase), lanePhase);
+            }
+        }
+        
+        const float (*rows)[numTaps];
+    };
+}
+
+/*********************************************************************************
+ *    Kernels
+ *********************************************************************************/
+
+/** Full scale of a source sample */
+static inline float sampleScale (const float *)         { return 1.0f; }
+static inline float sampleScale (const juce::int16 *)   { return 1.0f / 32767.0f; }
+
+template <class Interpolator, bool stereoIn, bool stereoOut, typename SampleType>
+static void renderRunKernel (RenderRun<SampleType> &run, int numFrames)
+{
+    const int width = V::width;
+
+    const SampleType *inL = run.inL;
+    const SampleType *inR = run.inR;
+    jassert ((inR != nullptr) == stereoIn && (run.outR != nullptr) == stereoOut);
+    
+    const Interpolator interpolator (run.increment);
+
+    // Integer samples are converted while interpolating, and scaled along with the note gain
+    const float scale = sampleScale(inL);
+    const float noteGainL = run.noteGainL * scale;
+    const float noteGainR = run.noteGainR * scale;
+    const V::Type gainL = V::set1(noteGainL);
+    const V::Type gainR = V::set1(noteGainR);
+    const V::Type half = V::set1(0.5f);
+
+    SamplePhase phase = run.phase;
+
+    for (; numFrames >= width; numFrames -= width)
+    {
+        alignas(32) float lanesL[width], lanesR[width];
+        interpolator.interpolateLanes(inL, phase, run.increment, lanesL);
+        if (stereoIn)
+            interpolator.interpolateLanes(inR, phase, run.increment, lanesR);
+
+        const V::Type env = V::load(run.gains);
+        run.gains += width;
+
+        V::Type l = V::load(lanesL);
+        V::Type r = stereoIn ? V::load(lanesR) : l;
+        l = V::mul(l, V::mul(gainL, env));
+        r = V::mul(r, V::mul(gainR, env));
+
+        if (stereoOut)
+        {
+            V::store(run.outL, V::add(V::load(run.outL), l));
+            V::store(run.outR, V::add(V::load(run.outR), r));
+            run.outL += width;
+            run.outR += width;
+        }
+        else
+        {
+            V::store(run.outL, V::add(V::load(run.outL), V::mul(V::add(l, r), half)));
+            run.outL += width;
+        }
+
+        phase += width * run.increment;
+    }
+
+    // Remaining frames, same math as above
+    for (; numFrames > 0; --numFrames)
+    {
+        const SamplePosition pos1 = samplePhaseIndex(phase);
+        const float env = *run.gains++;
+
+        float l = interpolator.interpolate(inL + pos1, phase);
+        float r = stereoIn ? interpolator.interpolate(inR + pos1, phase) : l;
+        l *= (noteGainL * env);
+        r *= (noteGainR * env);
+
+        if (stereoOut)
+        {
+            *run.outL++ += l;
+            *run.outR++ += r;
+        }
+        else
+        {
+            *run.outL++ += (l + r) * 0.5f;
+        }
+
+        phase += run.increment;
+    }
+
+    run.phase = phase;
+}
+
+template <class Interpolator, typename SampleType>
+static typename RenderRun<SampleType>::Function selectKernel (bool stereoIn, bool stereoOut)
+{
+    // Indexed by stereoIn * 2 + stereoOut
+    static const typename RenderRun<SampleType>::Function kernels[4] =
+    {
+        renderRunKernel<Interpolator, false, false, SampleType>,
+        renderRunKernel<Interpolator, false, true,  SampleType>,
+        renderRunKernel<Interpolator, true,  false, SampleType>,
+        renderRunKernel<Interpolator, true,  true,  SampleType>
+    };
+    return kernels[(stereoIn ? 2 : 0) + (stereoOut ? 1 : 0)];
+}
+
+template <typename SampleType>
+typename RenderRun<SampleType>::Function sfzero::getRenderRunFunction (InterpolationQuality quality, bool stereoIn, bool stereoOut)
+{
+    switch (quality)
+    {
+        case interpolateCubic:
+            return selectKernel<CubicInterpolator, SampleType>(stereoIn, stereoOut);
+        case interpolateSinc8:
+            return selectKernel<SincInterpolator<8>, SampleType>(stereoIn, stereoOut);
+        case interpolateSinc16:
+            return selectKernel<SincInterpolator<16>, SampleType>(stereoIn, stereoOut);
+        case interpolateLinear:
+        default:
+            return selectKernel<LinearInterpolator, SampleType>(stereoIn, stereoOut);
+    }
+}
+
+template RenderRun<float>::Function sfzero::getRenderRunFunction<float> (InterpolationQuality, bool, bool);
+template RenderRun<juce::int16>::Function sfzero::getRenderRunFunction<juce::int16> (InterpolationQuality, bool, bool);
+
+/*********************************************************************************
+ *    Setup
+ *********************************************************************************/
+
+void sfzero::getInterpolationReach (InterpolationQuality quality, int &tapsBefore, int &tapsAfter)
+{
+    switch (quality)
+    {
+        case interpolateCubic:
+            tapsBefore = CubicInterpolator::tapsBefore;
+            tapsAfter = CubicInterpolator::tapsAfter;
+            break;
+        case interpolateSinc8:
+            tapsBefore = SincInterpolator<8>::tapsBefore;
+            tapsAfter = SincInterpolator<8>::tapsAfter;
+            break;
+        case interpolateSinc16:
+            tapsBefore = SincInterpolator<16>::tapsBefore;
+            tapsAfter = SincInterpolator<16>::tapsAfter;
+            break;
+        case interpolateLinear:
+        default:
+            tapsBefore = LinearInterpolator::tapsBefore;
+            tapsAfter = LinearInterpolator::tapsAfter;
+            break;
+    }
+}
+
+void sfzero::prepareInterpolation (InterpolationQuality quality)
+{
+    // Tables are function-local statics, built on first use
+    if (quality == interpolateSinc8)
+        SincTable<8>::get();
+    else if (quality == interpolateSinc16)
+        SincTable<16>::get();
+}
@@ -0,0 +1,108 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZRENDER_H_INCLUDED
+#define SFZRENDER_H_INCLUDED
+
+#include "SF2WinTypes.h"
+#include "SFZSIMD.h"
+
+namespace sfzero
+{
+    /** Playback position as unsigned 32.32 fixed point: integer sample index in the
+        upper, fraction in the lower 32 bits. Index and fraction extraction are a shift
+        and a mask, and repeated addition of the increment never drifts. */
+    typedef juce::uint64 SamplePhase;
+    
+    static const int         samplePhaseBits = 32;
+    static const SamplePhase samplePhaseFractionMask = 0xFFFFFFFFull;
+    
+    inline SamplePhase samplePositionToPhase (SamplePosition pos)
+        { return static_cast<SamplePhase>(juce::jmax (pos, static_cast<SamplePosition>(0))) << samplePhaseBits; }
+    inline SamplePosition samplePhaseIndex (SamplePhase phase)
+        { return static_cast<SamplePosition>(phase >> samplePhaseBits); }
+    inline float samplePhaseFraction (SamplePhase phase)
+        { return static_cast<float>(static_cast<juce::uint32>(phase & samplePhaseFractionMask)) * (1.0f / 4294967296.0f); }
+    /** Rounds a pitch ratio to the fixed point increment, which is exact to 2^-32 samples per frame */
+    inline SamplePhase pitchRatioToPhaseIncrement (double ratio)
+        { return static_cast<SamplePhase>(ratio * 4294967296.0 + 0.5); }
+    
+    /** Interpolation between source samples, selectable per Synth. Higher quality costs
+        more CPU per voice, but aliases less when samples are transposed up. */
+    enum InterpolationQuality
+    {
+        interpolateLinear = 0,      // 2 taps
+        interpolateCubic,           // 4 taps, cubic Hermite (Catmull-Rom)
+        interpolateSinc8,           // 8 taps, Blackman-windowed sinc
+        interpolateSinc16,          // 16 taps, Blackman-windowed sinc
+        numInterpolationQualities
+    };
+    
+    /** Number of source samples an interpolator reads before and after the sample at
+        the integer playback position */
+    void getInterpolationReach (InterpolationQuality quality, int &tapsBefore, int &tapsAfter);
+    
+    /** Builds the coefficient tables of the given quality, if not done yet.
+        Call on a non-realtime thread before the quality is used for rendering. */
+    void prepareInterpolation (InterpolationQuality quality);
+    
+    /** State of a voice while rendering a run of frames with a RenderRun::Function.
+
+        A run must not cross a loop end or the sample end, and all interpolator taps
+        of its frames must be within the source buffer. The caller (Voice) splits blocks
+        into such runs, reads from a gathered window near loop and buffer edges, and
+        handles loop wrap and note end in between runs.
+     
+        Source samples are either float or int16. Kernels convert int16 samples to
+        float while interpolating, without scaling them: the 1/32767 scale of int16
+        samples is folded into the note gain once per run.
+     */
+    template <typename SampleType>
+    struct RenderRun
+    {
+        const SampleType *inL;
+        const SampleType *inR;  // nullptr for mono samples
+        float       *outL;
+        float       *outR;      // nullptr for mono output
+        const float *gains;     // amplitude EG, one per frame (see EG::renderBlock)
+        SamplePhase phase;      // source position of the next frame
+        SamplePhase increment;  // pitch ratio
+        float       noteGainL, noteGainR;
+        
+        /** Renders numFrames frames, processing FloatVector::width frames per step. Adds
+            to the output and advances phase, the gains and the output pointers of the run. */
+        typedef void (*Function) (RenderRun &run, int numFrames);
+    };
+
+    /** Kernels are specialized for interpolation quality, sample type and mono/stereo source
+        and output, so the inner loop has no data-independent branches. Select one per block.
+        Instantiated for float and juce::int16.
+     
+        Accuracy: the vector kernels (AVX2, SSE2, NEON) do the same operations per lane as
+        the scalar build (SFZERO_USE_SIMD off), except that the sinc interpolators sum their
+        taps in another order per vector width. Output differs from the scalar kernels by
+        float rounding only, below 1e-4 of full scale for runs of up to 4096 frames.
+     
+        Compared to the per-frame renderer of SFZero these replace, output differs by more
+        than rounding in these places, intentionally:
+        - At a loop seam, the tap after the loop end reads the loop start, so a loop plays
+          like it was unrolled. SFZero read the frame at the loop end there (see
+          Voice::renderRuns()).
+        - The playback position is exact to 2^-32 samples (see SamplePhase), where SFZero
+          accumulated it in double precision.
+     */
+    template <typename SampleType>
+    typename RenderRun<SampleType>::Function getRenderRunFunction (InterpolationQuality quality, bool stereoIn, bool stereoOut);
+}
+
+#endif // SFZRENDER_H_INCLUDED
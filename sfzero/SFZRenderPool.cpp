@@ -0,0 +1,162 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZRenderPool.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+class RenderPool::Worker : public Thread
+{
+public:
+    Worker (RenderPool &pool, int participant) :
+        Thread ("SFZero render worker"),
+        pool_ (pool),
+        participant_ (participant)
+    {}
+
+    void run() override
+    {
+        ScopedNoDenormals noDenormals;
+
+        while (!threadShouldExit())
+        {
+            wait (-1);
+
+            // Announce before looking at the job, so run() doesn't return while we might use it
+            ++pool_.numBusyWorkers_;
+            Job *job = pool_.job_.get();
+            if (job)
+            {
+                pool_.runTasks(*job, participant_);
+            }
+            --pool_.numBusyWorkers_;
+        }
+    }
+
+private:
+    RenderPool &pool_;
+    const int participant_;
+};
+
+
+RenderPool::RenderPool (int numWorkers) :
+    queues_ (nullptr),
+    numParticipants_ (numWorkers + 1),
+    numTasks_ (0),
+    job_ (nullptr)
+{
+    numTasksDone_.set(0);
+    numBusyWorkers_.set(0);
+
+    // HeapBlock memory is aligned for malloc only
+    queueStorage_.calloc(numParticipants_ * sizeof(Queue) + cacheLineSize - 1);
+    const pointer_sized_int base = reinterpret_cast<pointer_sized_int>(queueStorage_.getData());
+    queues_ = reinterpret_cast<Queue*>((base + cacheLineSize - 1) & ~static_cast<pointer_sized_int>(cacheLineSize - 1));
+    for (int i = 0; i < numParticipants_; ++i)
+        new (queues_ + i) Queue();
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        Worker *worker = workers_.add(new Worker(*this, i + 1));
+        // The audio thread waits for the workers, so they run at its priority where
+        // Juce supports it
+#if JUCE_VERSION >= 0x50300
+        worker->startThread(Thread::realtimeAudioPriority);
+#else
+        worker->startThread(9);
+#endif
+    }
+}
+
+RenderPool::~RenderPool()
+{
+    for (Worker *worker : workers_)
+    {
+        worker->signalThreadShouldExit();
+        worker->notify();
+    }
+    for (Worker *worker : workers_)
+    {
+        worker->stopThread(1000);
+    }
+    workers_.clear();
+}
+
+void RenderPool::runTasks (Job &job, int participant)
+{
+    // Task i is queued at participant (i % numParticipants_), as the (i / numParticipants_)th
+    for (int i = 0; i < numParticipants_; ++i)
+    {
+        const int queue = (participant + i) % numParticipants_;
+        for (;;)
+        {
+            const int task = queue + (++queues_[queue].next - 1) * numParticipants_;
+            if (task >= numTasks_)
+                break;
+
+            job.runTask(task);
+            if (++numTasksDone_ == numTasks_)
+                tasksDone_.signal();
+        }
+    }
+}
+
+void RenderPool::run (Job &job, int numTasks)
+{
+    if (numTasks <= 0)
+        return;
+
+    if (numTasks == 1 || workers_.size() == 0)
+    {
+        for (int i = 0; i < numTasks; ++i)
+            job.runTask(i);
+        return;
+    }
+
+    numTasks_ = numTasks;
+    numTasksDone_.set(0);
+    tasksDone_.reset();
+    for (int i = 0; i < numParticipants_; ++i)
+        queues_[i].next.set(0);
+    job_.set(&job);
+
+    // Wake only as many workers as there are tasks for besides our own
+    const int numWaking = jmin(workers_.size(), numTasks - 1);
+    for (int i = 0; i < numWaking; ++i)
+        workers_.getUnchecked(i)->notify();
+
+    runTasks(job, 0);
+
+    // Tasks stolen by workers may still be running. These usually end soon, so this
+    // spins briefly, and then blocks, so a worker preempted meanwhile can run on this
+    // core even if it has a lower priority.
+    for (int spins = 0; numTasksDone_.get() < numTasks; ++spins)
+    {
+        if (spins < maxSpins)
+            Thread::yield();
+        else
+            tasksDone_.wait(1);
+    }
+
+    // Workers are done with the job right after their last task
+    job_.set(nullptr);
+    for (int spins = 0; numBusyWorkers_.get() > 0; ++spins)
+    {
+        if (spins < maxSpins)
+            Thread::yield();
+        else
+            Thread::sleep(1);
+    }
+}
@@ -0,0 +1,89 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZRENDERPOOL_H_INCLUDED
+#define SFZRENDERPOOL_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+    /** Persistent worker threads at realtime priority, which help the audio thread
+        run the independent tasks of a block, e.g. rendering the channels of a MultiSynth.
+
+        The tasks of a run are dealt round-robin into one queue per participant (the
+        calling thread and each worker). Participants drain their own queue first and
+        then steal from the others, so a long task doesn't hold up the rest. Queues are
+        claimed with atomic counters: run() doesn't allocate, and returns when all tasks
+        are done. If a worker is still busy after a short spin, run() blocks rather than
+        spins, so the worker gets to finish even if preempted on the caller's core.
+        Workers run at Thread::realtimeAudioPriority with Juce 5.3 and later, and at
+        priority 9 before.
+     */
+
+    class RenderPool
+    {
+    public:
+
+        class Job
+        {
+        public:
+            virtual ~Job() {}
+            /** Called once for each index of a run, on any participating thread */
+            virtual void runTask (int index) = 0;
+        };
+
+        /** Starts numWorkers threads, which help the thread calling run() */
+        RenderPool (int numWorkers);
+        ~RenderPool();
+
+        int getNumWorkers() const { return workers_.size(); }
+
+        /** Runs job.runTask() for all indexes 0...numTasks-1, including on the calling thread.
+            Must not be called by more than one thread at a time. */
+        void run (Job &job, int numTasks);
+
+    private:
+
+        class Worker;
+
+        /** Runs tasks of the current job until none are left to claim, beginning with the own queue */
+        void runTasks (Job &job, int participant);
+
+        enum { cacheLineSize = 64 };
+
+        // Yields of the calling thread while waiting for workers, before it blocks, so
+        // a worker preempted on its core gets to finish
+        enum { maxSpins = 64 };
+
+        // A cache line each, as all participants claim from all queues
+        struct alignas(cacheLineSize) Queue
+        {
+            juce::Atomic<int> next;
+        };
+
+        juce::OwnedArray<Worker> workers_;
+        juce::HeapBlock<char>    queueStorage_;
+        Queue                   *queues_;   // in queueStorage_, aligned to a cache line
+        int                      numParticipants_;
+        int                      numTasks_;
+        juce::Atomic<Job*>       job_;
+        juce::Atomic<int>        numTasksDone_;
+        juce::Atomic<int>        numBusyWorkers_;
+        juce::WaitableEvent      tasksDone_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderPool)
+    };
+}
+
+#endif // SFZRENDERPOOL_H_INCLUDED
@@ -0,0 +1,114 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZSIMD_H_INCLUDED
+#define SFZSIMD_H_INCLUDED
+
+#include "SFZCommon.h"
+
+/** Select the widest vector instruction set the compiler was told to target.
+    AVX2 needs to be enabled explicitly (e.g. -mavx2 or /arch:AVX2), SSE2 is
+    implied on all x86-64 targets, NEON on all arm64 targets. */
+
+#if defined (SFZERO_USE_SIMD) && SFZERO_USE_SIMD
+ #if defined (__AVX2__)
+  #define SFZ_SIMD_AVX2 1
+  #include <immintrin.h>
+ #elif defined (__SSE2__) || defined (_M_X64) || defined (_M_AMD64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define SFZ_SIMD_SSE2 1
+  #include <emmintrin.h>
+ #elif defined (__ARM_NEON) || defined (__ARM_NEON__) || defined (_M_ARM64)
+  #define SFZ_SIMD_NEON 1
+  #include <arm_neon.h>
+ #endif
+#endif
+
+namespace sfzero
+{
+    /** Minimal wrapper around the native float vector, so render kernels can be
+        written once for AVX2 (8 lanes), SSE2/NEON (4 lanes) and plain scalar code (1 lane).
+        Loading from int16 converts width samples to float, without scaling. Each lane
+        rounds like scalar float code; see getRenderRunFunction() for how far kernels
+        built on this differ from the scalar ones. */
+    struct FloatVector
+    {
+#if SFZ_SIMD_AVX2
+        typedef __m256 Type;
+        enum { width = 8 };
+
+        static Type load  (const float *p)         { return _mm256_loadu_ps (p); }
+        static Type load  (const juce::int16 *p)   { return _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (p)))); }
+        static void store (float *p, Type v)       { _mm256_storeu_ps (p, v); }
+        static Type set1  (float v)                { return _mm256_set1_ps (v); }
+        static Type add   (Type a, Type b)         { return _mm256_add_ps (a, b); }
+        static Type sub   (Type a, Type b)         { return _mm256_sub_ps (a, b); }
+        static Type mul   (Type a, Type b)         { return _mm256_mul_ps (a, b); }
+        static float sum  (Type v)
+        {
+            __m128 s = _mm_add_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1));
+            s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+            return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, 1)));
+        }
+#elif SFZ_SIMD_SSE2
+        typedef __m128 Type;
+        enum { width = 4 };
+
+        static Type load  (const float *p)         { return _mm_loadu_ps (p); }
+        static Type load  (const juce::int16 *p)
+        {
+            const __m128i x = _mm_loadl_epi64 (reinterpret_cast<const __m128i*> (p));
+            return _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (x, x), 16));
+        }
+        static void store (float *p, Type v)       { _mm_storeu_ps (p, v); }
+        static Type set1  (float v)                { return _mm_set1_ps (v); }
+        static Type add   (Type a, Type b)         { return _mm_add_ps (a, b); }
+        static Type sub   (Type a, Type b)         { return _mm_sub_ps (a, b); }
+        static Type mul   (Type a, Type b)         { return _mm_mul_ps (a, b); }
+        static float sum  (Type v)
+        {
+            __m128 s = _mm_add_ps (v, _mm_movehl_ps (v, v));
+            return _mm_cvtss_f32 (_mm_add_ss (s, _mm_shuffle_ps (s, s, 1)));
+        }
+#elif SFZ_SIMD_NEON
+        typedef float32x4_t Type;
+        enum { width = 4 };
+
+        static Type load  (const float *p)         { return vld1q_f32 (p); }
+        static Type load  (const juce::int16 *p)   { return vcvtq_f32_s32 (vmovl_s16 (vld1_s16 (p))); }
+        static void store (float *p, Type v)       { vst1q_f32 (p, v); }
+        static Type set1  (float v)                { return vdupq_n_f32 (v); }
+        static Type add   (Type a, Type b)         { return vaddq_f32 (a, b); }
+        static Type sub   (Type a, Type b)         { return vsubq_f32 (a, b); }
+        static Type mul   (Type a, Type b)         { return vmulq_f32 (a, b); }
+        static float sum  (Type v)
+        {
+            float32x2_t s = vadd_f32 (vget_low_f32 (v), vget_high_f32 (v));
+            return vget_lane_f32 (vpadd_f32 (s, s), 0);
+        }
+#else
+        typedef float Type;
+        enum { width = 1 };
+
+        static Type load  (const float *p)         { return *p; }
+        static Type load  (const juce::int16 *p)   { return static_cast<float> (*p); }
+        static void store (float *p, Type v)       { *p = v; }
+        static Type set1  (float v)                { return v; }
+        static Type add   (Type a, Type b)         { return a + b; }
+        static Type sub   (Type a, Type b)         { return a - b; }
+        static Type mul   (Type a, Type b)         { return a * b; }
+        static float sum  (Type v)                 { return v; }
+#endif
+    };
+}
+
+#endif // SFZSIMD_H_INCLUDED
@@ -13,11 +13,14 @@
 
 #include "SFZSample.h"
 #include "SFZDebug.h"
+#include "SFZSampleArena.h"
 
 using namespace juce;
 using namespace sfzero;
 
-bool Sample::load (AudioFormatManager *formatManager)
+Atomic<int> Sample::reloadRequested_ (0);
+
+bool Sample::load (AudioFormatManager *formatManager, int preloadTime)
 {
     ScopedPointer<AudioFormatReader> reader (formatManager->createReaderFor(file_));
     
@@ -26,22 +29,170 @@ bool Sample::load (AudioFormatManager *formatManager)
     
     DBG ("Loading Sample " << file_.getFullPathName());
     
-    sampleRate_   = reader->sampleRate;
-    sampleLength_ = reader->lengthInSamples;
-    // Read some extra samples, which will be filled with zeros, so interpolation
-    // can be done without having to check for the edge all the time.
-    jassert(sampleLength_ < std::numeric_limits<int>::max());
+    readInfo(*reader);
+    bool streamed = false;
+    const int bufferLength = bufferLengthFor(preloadTime, streamed);
+    
+    AudioSampleBuffer *buffer = new AudioSampleBuffer (reader->numChannels, bufferLength);
+    reader->read (buffer, 0, bufferLength, 0, true, true);
+    streamed_ = streamed;
+    buffer_ = buffer;
+    return true;
+}
+
+int Sample::readFormat (AudioFormatManager *formatManager, int preloadTime, int &numChannels)
+{
+    ScopedPointer<AudioFormatReader> reader (formatManager->createReaderFor(file_));
+    
+    if (reader == nullptr)
+        return 0;
+    
+    readInfo(*reader);
+    numChannels = static_cast<int>(reader->numChannels);
+    bool streamed = false;
+    return bufferLengthFor(preloadTime, streamed);
+}
+
+bool Sample::load (AudioFormatManager *formatManager, int preloadTime,
+                   float * const *channels, int numChannels, int capacity)
+{
+    ScopedPointer<AudioFormatReader> reader (formatManager->createReaderFor(file_));
+    
+    if (reader == nullptr)
+        return false;
     
-    buffer_ = new AudioSampleBuffer (reader->numChannels, static_cast<int>(sampleLength_ + 4));
-    reader->read (buffer_, 0, static_cast<int>(sampleLength_ + 4), 0, true, true);
+    DBG ("Loading Sample " << file_.getFullPathName());
+    
+    // The file may have changed since its format was read
+    readInfo(*reader);
+    bool streamed = false;
+    const int bufferLength = bufferLengthFor(preloadTime, streamed);
+    if (static_cast<int>(reader->numChannels) != numChannels || bufferLength > capacity)
+        return false;
+    
+    AudioSampleBuffer *buffer = new AudioSampleBuffer (channels, numChannels, bufferLength);
+    reader->read (buffer, 0, bufferLength, 0, true, true);
+    channels_ = Array<float*> (channels, numChannels);
+    capacity_ = capacity;
+    streamed_ = streamed;
+    buffer_ = buffer;
+    return true;
+}
+
+void Sample::readInfo (AudioFormatReader &reader)
+{
+    sampleRate_   = reader.sampleRate;
+    sampleLength_ = reader.lengthInSamples;
+    jassert(sampleLength_ < std::numeric_limits<int>::max());
     
-    StringPairArray *metadata = &reader->metadataValues;
+    StringPairArray *metadata = &reader.metadataValues;
     int numLoops = metadata->getValue("NumSampleLoops", "0").getIntValue();
     if (numLoops > 0)
     {
         loopStart_ = metadata->getValue("Loop0Start", "0").getLargeIntValue();
         loopEnd_   = metadata->getValue("Loop0End", "0").getLargeIntValue();
     }
+}
+
+int Sample::bufferLengthFor (int preloadTime, bool &streamed) const
+{
+    // A streamed sample keeps its head only. The voice switches to the stream before
+    // reaching the end of it, so it needs no extra samples. Otherwise, read some extra
+    // samples, which will be filled with zeros, so interpolation can be done without
+    // having to check for the edge all the time.
+    const int64 headLength = jmax(static_cast<int64>(preloadTime * sampleRate_ / 1000.0), static_cast<int64>(minPreloadLength));
+    streamed = (preloadTime > 0) && (static_cast<uint64>(headLength) < sampleLength_);
+    return static_cast<int>(streamed ? headLength : sampleLength_ + 4);
+}
+
+bool Sample::reload (AudioFormatManager *formatManager, int preloadTime)
+{
+    if (isInUse())
+        return false;
+    
+    if (!channels_.isEmpty())
+        return reloadInPlace(formatManager, preloadTime);
+    
+    ScopedPointer<AudioFormatReader> reader (formatManager->createReaderFor(file_));
+    if (reader == nullptr || static_cast<uint64>(reader->lengthInSamples) != sampleLength_)
+        return false;
+    
+    bool streamed = false;
+    const int bufferLength = bufferLengthFor(preloadTime, streamed);
+    if (preloadTime > 0 && !streamed)
+        return false;
+    
+    AudioSampleBuffer *buffer = new AudioSampleBuffer (reader->numChannels, bufferLength);
+    reader->read (buffer, 0, bufferLength, 0, true, true);
+    if (!replaceBuffer(buffer, streamed))
+    {
+        delete buffer;
+        return false;
+    }
+    return true;
+}
+
+bool Sample::reloadInPlace (AudioFormatManager *formatManager, int preloadTime)
+{
+    bool streamed = false;
+    const int bufferLength = bufferLengthFor(preloadTime, streamed);
+    if ((preloadTime > 0 && !streamed) || bufferLength > capacity_)
+        return false;
+    
+    AudioSampleBuffer *current = buffer_.get();
+    const int loaded = (current != nullptr) ? current->getNumSamples() : 0;
+    AudioSampleBuffer *buffer = new AudioSampleBuffer (channels_.getRawDataPointer(), channels_.size(), bufferLength);
+    
+    // Voices using the current buffer don't read past its end, so the rest can be
+    // read meanwhile
+    if (bufferLength > loaded)
+    {
+        ScopedPointer<AudioFormatReader> reader (formatManager->createReaderFor(file_));
+        if (reader == nullptr || static_cast<uint64>(reader->lengthInSamples) != sampleLength_)
+        {
+            delete buffer;
+            return false;
+        }
+        reader->read (buffer, loaded, bufferLength - loaded, loaded, true, true);
+    }
+    if (!replaceBuffer(buffer, streamed))
+    {
+        delete buffer;
+        return false;
+    }
+    for (float *channel : channels_)
+    {
+        SampleArena::release(channel + bufferLength, capacity_ - bufferLength);
+    }
+    return true;
+}
+
+bool Sample::useData (SampleData *data)
+{
+    if (data->getChannels() == channels_)
+    {
+        data_ = data;
+        return true;
+    }
+    
+    AudioSampleBuffer *current = buffer_.get();
+    if (current == nullptr || data->getChannels().size() != channels_.size())
+        return false;
+    
+    AudioSampleBuffer *buffer = new AudioSampleBuffer (data->getChannels().begin(), channels_.size(), current->getNumSamples());
+    if (!replaceBuffer(buffer, streamed_))
+    {
+        delete buffer;
+        return false;
+    }
+    for (float *channel : channels_)
+    {
+        SampleArena::release(channel, capacity_);
+    }
+    channels_ = data->getChannels();
+    capacity_ = data->getCapacity();
+    data_ = data;
+    usesSharedData_ = true;
     return true;
 }
 
@@ -56,15 +207,56 @@ String Sample::getShortName()
 
 void Sample::setBuffer (AudioSampleBuffer *newBuffer)
 {
+    jassert(newBuffer != nullptr);
+    if (newBuffer == nullptr)
+        return;
+    
+    sampleLength_ = newBuffer->getNumSamples();
     buffer_ = newBuffer;
-    sampleLength_ = buffer_->getNumSamples();
+}
+
+void Sample::setInt16Data (const int16 *data, int numSamples)
+{
+    int16Data_ = data;
+    sampleLength_ = numSamples;
 }
 
 AudioSampleBuffer *Sample::detachBuffer()
 {
-    AudioSampleBuffer *result = buffer_;
-    buffer_ = nullptr;
-    return result;
+    return buffer_.exchange(nullptr);
+}
+
+bool Sample::releaseBuffer()
+{
+    return replaceBuffer(nullptr, false);
+}
+
+bool Sample::replaceBuffer (AudioSampleBuffer *newBuffer, bool streamed)
+{
+    // A voice adds itself as a user before getting the buffer. So if there's no user
+    // after the buffer was taken away, no voice got it, and none will. A voice getting
+    // the new buffer sees whether it is streamed, which is set before.
+    if (numUsers_.get() > 0)
+        return false;
+    
+    AudioSampleBuffer *buffer = buffer_.exchange(nullptr);
+    if (numUsers_.get() > 0)
+    {
+        buffer_ = buffer;
+        return false;
+    }
+    delete buffer;
+    streamed_ = streamed;
+    buffer_ = newBuffer;
+    return true;
+}
+
+int64 Sample::getMemorySize() const
+{
+    const AudioSampleBuffer *buffer = buffer_.get();
+    if (buffer == nullptr)
+        return 0;
+    return buffer->getNumChannels() * static_cast<int64>(buffer->getNumSamples()) * static_cast<int64>(sizeof(float));
 }
 
 String Sample::dump()
@@ -75,15 +267,16 @@ String Sample::dump()
 #ifdef JUCE_DEBUG
 void Sample::checkIfZeroed (const char *where)
 {
-    if (buffer_ == nullptr)
+    AudioSampleBuffer *buffer = buffer_.get();
+    if (buffer == nullptr)
     {
         dbgprintf("Sample::checkIfZeroed(%s): no buffer!", where);
         return;
     }
     
-    int samplesLeft = buffer_->getNumSamples();
+    int samplesLeft = buffer->getNumSamples();
     int64 nonzero = 0, zero = 0;
-    const float *p = buffer_->getReadPointer(0);
+    const float *p = buffer->getReadPointer(0);
     for (; samplesLeft > 0; --samplesLeft)
     {
         if (*p++ == 0.0)
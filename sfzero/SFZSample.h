@@ -15,6 +15,7 @@
 #define SFZSAMPLE_H_INCLUDED
 
 #include "SFZCommon.h"
+#include "SFZSampleData.h"
 
 namespace sfzero
 {
@@ -26,32 +27,139 @@ namespace sfzero
         explicit Sample (const juce::File &fileIn) :
             file_(fileIn),
             buffer_(nullptr),
+            capacity_(0),
+            data_(),
+            usesSharedData_(false),
+            int16Data_(nullptr),
             sampleRate_(0),
             sampleLength_(0),
             loopStart_(0),
-            loopEnd_(0)
+            loopEnd_(0),
+            streamed_(false),
+            numUsers_(0),
+            lastUsed_(juce::Time::getMillisecondCounter()),
+            evicted_(0),
+            wanted_(0)
         {}
         
         explicit Sample (double sampleRateIn) :
             buffer_(nullptr),
+            capacity_(0),
+            data_(),
+            usesSharedData_(false),
+            int16Data_(nullptr),
             sampleRate_(sampleRateIn),
             sampleLength_(0),
             loopStart_(0),
-            loopEnd_(0)
+            loopEnd_(0),
+            streamed_(false),
+            numUsers_(0),
+            lastUsed_(juce::Time::getMillisecondCounter()),
+            evicted_(0),
+            wanted_(0)
         {}
         
         virtual ~Sample();
         
-        bool load (juce::AudioFormatManager *formatManager);
+        /** Reads the sample file. With a preload time (ms), only that much of a longer
+            sample is read, and the rest is streamed from disk while playing. */
+        bool load (juce::AudioFormatManager *formatManager, int preloadTime = 0);
+        
+        /** Reads the format of the sample file. Returns the frames per channel load() would
+            read, or 0 if not readable. */
+        int readFormat (juce::AudioFormatManager *formatManager, int preloadTime, int &numChannels);
+        
+        /** Like load(), but reads into channels of capacity frames each, owned by someone
+            else (see SampleArena). The buffer refers to them. */
+        bool load (juce::AudioFormatManager *formatManager, int preloadTime,
+                   float * const *channels, int numChannels, int capacity);
+        
+        /** Reads the sample file again like load(), and replaces the buffer, unless in use.
+            Returns false if in use, not readable, or nothing would be streamed with a
+            preload time. Data owned by someone else is kept in place: a head is the
+            start of it, and the rest of it is released. */
+        bool reload (juce::AudioFormatManager *formatManager, int preloadTime = 0);
+        
+        /** Data of the channels loaded above, once shared, see SharedResources::shareSampleData() */
+        SampleData *getData() const { return data_.get(); }
+        
+        /** After load() into channels, uses data of the same content instead, unless in
+            use. Data of other samples replaces the own channels, which are released. */
+        bool useData (SampleData *data);
+        
+        /** True if the data used is another sample's, which counts its memory */
+        bool usesSharedData() const { return usesSharedData_; }
+        
+        /** Called once no other sample uses the data anymore, so this one may change it */
+        void stopSharingData() { usesSharedData_ = false; }
         
         juce::File getFile() { return file_; }
         juce::String getShortName();
         double getSampleRate() { return sampleRate_; }
         
-        juce::AudioSampleBuffer *getBuffer() { return buffer_; }
+        juce::AudioSampleBuffer *getBuffer() { return buffer_.get(); }
+        /** Sets a buffer, which must not be nullptr (see releaseBuffer()) */
         void setBuffer (juce::AudioSampleBuffer *newBuffer);
         juce::AudioSampleBuffer *detachBuffer();
         
+        /** A voice playing the sample is a user of its data from before getting the data
+            until done with it. Data loaded on demand is only released while unused.
+            Realtime-safe. */
+        void addUser()
+        {
+            ++numUsers_;
+            lastUsed_.set(juce::Time::getMillisecondCounter());
+            if (evicted_.get() != 0)
+            {
+                wanted_.set(1);
+                reloadRequested_.set(1);
+            }
+        }
+        void removeUser()
+        {
+            // A wanted sample is reloaded once its last voice is done
+            if (--numUsers_ == 0 && wanted_.get() != 0)
+                reloadRequested_.set(1);
+        }
+        bool isInUse() const { return numUsers_.get() > 0; }
+        
+        /** Deletes the buffer, unless in use. Returns false if in use. */
+        bool releaseBuffer();
+        
+        /** Deletes the buffer and sets newBuffer instead, unless in use. Returns false
+            without taking ownership of newBuffer if in use. */
+        bool replaceBuffer (juce::AudioSampleBuffer *newBuffer, bool streamed);
+        
+        /** Bytes of the float buffer. With SF2, the buffer may be shared by other samples. */
+        juce::int64 getMemorySize() const;
+        
+        /** Millisecond counter (see juce::Time) of the last time a voice started playing
+            the sample, or of its creation */
+        juce::uint32 getLastUsed() const { return lastUsed_.get(); }
+        
+        /** Set if the data was evicted to save memory, see SharedResources::setMemoryBudget().
+            An evicted sample is wanted once a voice played it again, so its data is reloaded. */
+        bool isEvicted() const { return evicted_.get() != 0; }
+        bool isWanted() const { return wanted_.get() != 0; }
+        void setEvicted (bool evicted) { evicted_.set(evicted ? 1 : 0); wanted_.set(0); }
+        
+        /** True once after a sample became wanted or a wanted sample became unused,
+            so the SampleLoader reloads it. Wait-free. */
+        static bool takeReloadRequest() { return reloadRequested_.exchange(0) != 0; }
+        
+        /** Range of the sample in the sample data of its file, for data loaded on demand */
+        juce::Range<juce::int64> getSourceRange() const { return sourceRange_; }
+        void setSourceRange (juce::Range<juce::int64> range) { sourceRange_ = range; }
+        
+        /** Mono int16 sample data owned by someone else, used instead of a float buffer */
+        const juce::int16 *getInt16Data() const { return int16Data_; }
+        void setInt16Data (const juce::int16 *data, int numSamples);
+        
+        bool hasData() const { return buffer_.get() != nullptr || int16Data_ != nullptr; }
+        
+        /** True if the buffer holds the head of the sample only, see SampleStream */
+        bool isStreamed() const { return streamed_; }
+        
         juce::String dump();
         juce::uint64 getSampleLength() const { return sampleLength_; }
         juce::uint64 getLoopStart() const { return loopStart_; }
@@ -65,11 +173,29 @@ namespace sfzero
         juce::String name;
         
     private:
+        enum { minPreloadLength = 256 }; // frames
+        
+        void readInfo (juce::AudioFormatReader &reader);
+        int  bufferLengthFor (int preloadTime, bool &streamed) const;
+        bool reloadInPlace (juce::AudioFormatManager *formatManager, int preloadTime);
+        
         juce::File file_;
-        // With SF2, all samples point to a single buffer
-        juce::AudioSampleBuffer *buffer_;
+        // With SF2, all samples point to a single buffer, unless loaded on demand
+        juce::Atomic<juce::AudioSampleBuffer*> buffer_;
+        // Channels of data owned by someone else, with capacity frames each
+        juce::Array<float*> channels_;
+        int capacity_;
+        SampleData::Ptr data_;
+        bool usesSharedData_;
+        const juce::int16 *int16Data_;
         double sampleRate_;
         juce::uint64 sampleLength_, loopStart_, loopEnd_;
+        bool streamed_;
+        juce::Atomic<int> numUsers_;
+        juce::Atomic<juce::uint32> lastUsed_;
+        juce::Atomic<int> evicted_, wanted_;
+        static juce::Atomic<int> reloadRequested_;
+        juce::Range<juce::int64> sourceRange_;
         
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Sample)
     };
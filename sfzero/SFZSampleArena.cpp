@@ -0,0 +1,82 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZSampleArena.h"
+
+#if JUCE_MAC || JUCE_IOS || JUCE_LINUX || JUCE_ANDROID
+ #include <sys/mman.h>
+#endif
+
+using namespace juce;
+using namespace sfzero;
+
+
+size_t SampleArena::bytesFor (int numFrames)
+{
+    const size_t bytes = static_cast<size_t>(jmax(0, numFrames)) * sizeof(float) + guardBytes;
+    return (bytes + alignment - 1) & ~static_cast<size_t>(alignment - 1);
+}
+
+SampleArena::SampleArena (size_t numBytes) :
+    block_ (),
+    data_ (nullptr),
+    size_ (numBytes),
+    used_ (0)
+{
+    // Zeroed by the allocator, which maps fresh pages for large blocks anyway
+    const size_t blockAlignment = (numBytes >= hugePageSize) ? hugePageSize : alignment;
+    block_.calloc(numBytes + blockAlignment);
+    if (block_.getData() == nullptr)
+    {
+        size_ = 0;
+        return;
+    }
+    const size_t address = reinterpret_cast<size_t>(block_.getData());
+    data_ = block_.getData() + ((blockAlignment - address % blockAlignment) % blockAlignment);
+
+#if JUCE_LINUX || JUCE_ANDROID
+ #ifdef MADV_HUGEPAGE
+    if (blockAlignment == hugePageSize)
+        madvise(data_, numBytes & ~static_cast<size_t>(hugePageSize - 1), MADV_HUGEPAGE);
+ #endif
+#endif
+}
+
+SampleArena::~SampleArena ()
+{
+}
+
+float *SampleArena::allocate (int numFrames)
+{
+    const size_t bytes = bytesFor(numFrames);
+    if (used_ + bytes > size_)
+        return nullptr;
+
+    float *data = reinterpret_cast<float*>(data_ + used_);
+    used_ += bytes;
+    return data;
+}
+
+void SampleArena::release (float *data, int numFrames)
+{
+#if JUCE_MAC || JUCE_IOS || JUCE_LINUX || JUCE_ANDROID
+    const size_t start = reinterpret_cast<size_t>(data);
+    const size_t end = start + static_cast<size_t>(jmax(0, numFrames)) * sizeof(float);
+    const size_t firstPage = (start + pageSize - 1) & ~static_cast<size_t>(pageSize - 1);
+    const size_t lastPage = end & ~static_cast<size_t>(pageSize - 1);
+    if (firstPage < lastPage)
+        madvise(reinterpret_cast<void*>(firstPage), lastPage - firstPage, MADV_DONTNEED);
+#else
+    ignoreUnused(data, numFrames);
+#endif
+}
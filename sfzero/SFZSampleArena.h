@@ -0,0 +1,63 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZSAMPLEARENA_H_INCLUDED
+#define SFZSAMPLEARENA_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+    /** One block of memory holding the sample data of all samples of a SFZ file, so
+        loading them takes a single allocation, and freeing them too.
+
+        Each channel of a sample starts at a cache line boundary, and is followed by a
+        guard of zeros, so interpolation may read a little past its end. Large arenas
+        are aligned for huge pages, which the system is asked to use where supported.
+        Reference counted, since samples of other files may share data in it (see
+        SampleData).
+     */
+
+    class SampleArena : public juce::ReferenceCountedObject
+    {
+    public:
+        typedef juce::ReferenceCountedObjectPtr<SampleArena> Ptr;
+
+        /** Bytes needed for a channel of numFrames, including alignment and guard */
+        static size_t bytesFor (int numFrames);
+
+        explicit SampleArena (size_t numBytes);
+        ~SampleArena();
+
+        /** Zeroed memory for a channel of numFrames, or nullptr if the arena is full */
+        float *allocate (int numFrames);
+
+        size_t getSize() const { return size_; }
+
+        /** Gives the whole pages within numFrames from data on back to the system, so
+            they take no memory until written again. Their contents are lost. Does nothing
+            where not supported. */
+        static void release (float *data, int numFrames);
+
+    private:
+        enum { alignment = 64, guardBytes = 64, pageSize = 4096, hugePageSize = 2 << 20 };
+
+        juce::HeapBlock<char> block_;
+        char *data_;
+        size_t size_, used_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleArena)
+    };
+}
+
+#endif // SFZSAMPLEARENA_H_INCLUDED
@@ -0,0 +1,119 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZSampleData.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+SampleData::SampleData (AudioSampleBuffer *buffer) :
+    buffer_ (buffer),
+    int16Data_ (),
+    numInt16Samples_ (0),
+    arena_ (),
+    channels_ (),
+    capacity_ (0)
+{
+    computeKey("float");
+}
+
+SampleData::SampleData (HeapBlock<int16> &data, int numSamples) :
+    buffer_ (),
+    int16Data_ (),
+    numInt16Samples_ (numSamples),
+    arena_ (),
+    channels_ (),
+    capacity_ (0)
+{
+    int16Data_.swapWith(data);
+    computeKey("int16");
+}
+
+SampleData::SampleData (SampleArena *arena, const Array<float*> &channels, int capacity, int numFrames) :
+    buffer_ (new AudioSampleBuffer (channels.begin(), channels.size(), numFrames)),
+    int16Data_ (),
+    numInt16Samples_ (0),
+    arena_ (arena),
+    channels_ (channels),
+    capacity_ (capacity)
+{
+    computeKey("float");
+}
+
+SampleData::~SampleData ()
+{
+}
+
+void SampleData::computeKey (const char *kind)
+{
+    uint64 h = 0;
+    size_t numBytes = 0;
+    if (buffer_ != nullptr)
+    {
+        // Channels may be apart, so they are hashed one after the other
+        numBytes = buffer_->getNumSamples() * sizeof(float);
+        for (int c = 0; c < buffer_->getNumChannels(); ++c)
+            h = hash(buffer_->getReadPointer(c), numBytes, h);
+        key_ << kind << buffer_->getNumChannels() << "x";
+    }
+    else
+    {
+        numBytes = numInt16Samples_ * sizeof(int16);
+        h = hash(int16Data_.getData(), numBytes, h);
+        key_ << kind;
+    }
+    key_ << static_cast<int64>(numBytes) << "-" << String::toHexString(static_cast<int64>(h));
+}
+
+bool SampleData::hasSameData (const SampleData &other) const
+{
+    if (key_ != other.key_)
+        return false;
+
+    if (buffer_ != nullptr)
+    {
+        const size_t numBytes = buffer_->getNumSamples() * sizeof(float);
+        for (int c = 0; c < buffer_->getNumChannels(); ++c)
+        {
+            if (memcmp(buffer_->getReadPointer(c), other.buffer_->getReadPointer(c), numBytes) != 0)
+                return false;
+        }
+        return true;
+    }
+    return memcmp(int16Data_.getData(), other.int16Data_.getData(), numInt16Samples_ * sizeof(int16)) == 0;
+}
+
+uint64 SampleData::hash (const void *data, size_t numBytes, uint64 seed)
+{
+    // Eight bytes at a time, multiplied and folded, so hashing is much faster than
+    // reading the data from disk
+    static const uint64 multiplier = 0x9e3779b97f4a7c15ULL;
+    const char *bytes = static_cast<const char*>(data);
+    uint64 h = seed ^ (numBytes * multiplier);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64) <= numBytes; i += sizeof(uint64))
+    {
+        uint64 word;
+        memcpy(&word, bytes + i, sizeof(word));
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+    for (; i < numBytes; ++i)
+    {
+        h = (h ^ static_cast<uint8>(bytes[i])) * multiplier;
+        h ^= h >> 29;
+    }
+    return h;
+}
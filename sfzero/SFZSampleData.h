@@ -0,0 +1,76 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZSAMPLEDATA_H_INCLUDED
+#define SFZSAMPLEDATA_H_INCLUDED
+
+#include "SFZSampleArena.h"
+
+namespace sfzero
+{
+    /** Sample data keyed by a hash of its content, so files and samples with the same
+        data can share it, see SharedResources::shareSampleData().
+
+        Holds either float data, owned or in a SampleArena, or int16 data as stored in
+        a SF2 file.
+     */
+
+    class SampleData : public juce::ReferenceCountedObject
+    {
+    public:
+        typedef juce::ReferenceCountedObjectPtr<SampleData> Ptr;
+
+        /** Takes ownership of the buffer */
+        explicit SampleData (juce::AudioSampleBuffer *buffer);
+
+        /** Takes over the data */
+        SampleData (juce::HeapBlock<juce::int16> &data, int numSamples);
+
+        /** Channels in an arena of capacity frames each, of which numFrames are used */
+        SampleData (SampleArena *arena, const juce::Array<float*> &channels, int capacity, int numFrames);
+
+        ~SampleData();
+
+        /** Hash of the content, its size and kind */
+        const juce::String &getKey() const { return key_; }
+
+        /** Compares the content, for data with the same key */
+        bool hasSameData (const SampleData &other) const;
+
+        juce::AudioSampleBuffer *getBuffer() const { return buffer_.get(); }
+        const juce::int16 *getInt16Data() const { return int16Data_; }
+        int getNumInt16Samples() const { return numInt16Samples_; }
+
+        /** Channels in the arena, if any, see above */
+        const juce::Array<float*> &getChannels() const { return channels_; }
+        int getCapacity() const { return capacity_; }
+
+        /** A fast hash of numBytes of data, not cryptographic */
+        static juce::uint64 hash (const void *data, size_t numBytes, juce::uint64 seed = 0);
+
+    private:
+        void computeKey (const char *kind);
+
+        std::unique_ptr<juce::AudioSampleBuffer> buffer_;
+        juce::HeapBlock<juce::int16> int16Data_;
+        int numInt16Samples_;
+        SampleArena::Ptr arena_;
+        juce::Array<float*> channels_;
+        int capacity_;
+        juce::String key_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleData)
+    };
+}
+
+#endif // SFZSAMPLEDATA_H_INCLUDED
@@ -0,0 +1,162 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZSampleLoader.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+juce_ImplementSingleton (sfzero::SampleLoader)
+
+SampleLoader::SampleLoader () :
+    Thread ("SFZero sample loader"),
+    budgetRequested_ (0),
+    lastBudgetCheck_ (0)
+{
+    formatManager_.registerBasicFormats();
+}
+
+SampleLoader::~SampleLoader ()
+{
+    stopThread(4000);
+    resources_.clear();
+    clearSingletonInstance();
+}
+
+void SampleLoader::add (SharedResourceBase *resources)
+{
+    ScopedLock locker (lock_);
+
+    resources_.addIfNotAlreadyThere(resources);
+    requestBudgetCheck();
+    if (!isThreadRunning())
+    {
+        startThread();
+    }
+}
+
+void SampleLoader::run ()
+{
+    while (!threadShouldExit())
+    {
+        wait(pollInterval);
+
+        // Resources used by the loader only, besides the SharedResources, are released
+        // when "unused" goes out of scope, after the lock is exited. The SharedResources
+        // delete them then.
+        ReferenceCountedArray<SharedResourceBase> unused, used;
+        {
+            ScopedLock locker (lock_);
+            for (int i = resources_.size(); --i >= 0;)
+            {
+                if (resources_.getObjectPointer(i)->getReferenceCount() == 2)
+                {
+                    unused.add(resources_.getObjectPointer(i));
+                    resources_.remove(i);
+                    requestBudgetCheck();
+                }
+                else
+                {
+                    used.add(resources_.getObjectPointer(i));
+                }
+            }
+        }
+        if (unused.size() > 0)
+        {
+            unused.clear();
+            if (SharedResources::getInstanceWithoutCreating() != nullptr)
+                SharedResources::getInstance()->releaseUnused();
+        }
+        for (SharedResourceBase *resources : used)
+        {
+            resources->updateResidency(this);
+        }
+
+        // Checking the budget visits all samples, so it's done when requested, or when
+        // samples played again are to be reloaded. Otherwise, changes noticed by no one,
+        // like samples loaded on demand, are caught by checking once in a while.
+        SharedResources *sharedResources = SharedResources::getInstanceWithoutCreating();
+        if (sharedResources != nullptr && sharedResources->getMemoryBudget() > 0)
+        {
+            const uint32 now = Time::getMillisecondCounter();
+            const bool reloadRequested = Sample::takeReloadRequest();
+            if (budgetRequested_.exchange(0) != 0 || reloadRequested || now - lastBudgetCheck_ >= budgetInterval)
+            {
+                lastBudgetCheck_ = now;
+                applyMemoryBudget(used, sharedResources->getMemoryBudget());
+            }
+        }
+    }
+}
+
+namespace
+{
+    struct EvictionOrder
+    {
+        EvictionOrder (uint32 nowIn) : now (nowIn) {}
+
+        // Least recently used first. Ages are compared, so the wrap of the millisecond
+        // counter doesn't matter.
+        int compareElements (const std::pair<Sample*, SharedResourceBase*> &a,
+                             const std::pair<Sample*, SharedResourceBase*> &b) const
+        {
+            const uint32 ageA = now - a.first->getLastUsed();
+            const uint32 ageB = now - b.first->getLastUsed();
+            return (ageA > ageB) ? -1 : ((ageA < ageB) ? 1 : 0);
+        }
+
+        uint32 now;
+    };
+}
+
+void SampleLoader::applyMemoryBudget (const ReferenceCountedArray<SharedResourceBase> &resources, int64 budget)
+{
+    // Samples played again are reloaded first, so the least recently used ones are
+    // evicted in their place
+    for (SharedResourceBase *r : resources)
+    {
+        r->reloadSamples(formatManager_, this);
+    }
+
+    int64 used = 0;
+    for (SharedResourceBase *r : resources)
+    {
+        used += r->getMemoryUsage();
+    }
+    if (used <= budget || threadShouldExit())
+        return;
+
+    Array<std::pair<Sample*, SharedResourceBase*>> candidates;
+    for (SharedResourceBase *r : resources)
+    {
+        Array<Sample*> samples;
+        r->addEvictableSamples(samples);
+        for (Sample *sample : samples)
+            candidates.add(std::make_pair(sample, r));
+    }
+    EvictionOrder order (Time::getMillisecondCounter());
+    candidates.sort(order, true);
+
+    for (const std::pair<Sample*, SharedResourceBase*> &candidate : candidates)
+    {
+        // Samples played recently are not evicted, so they don't reload over and over
+        if (used <= budget || threadShouldExit() || order.now - candidate.first->getLastUsed() < minResidentTime)
+            break;
+
+        // Samples in use are skipped, and evicted later if still needed
+        const int64 size = candidate.first->getMemorySize();
+        if (candidate.second->evictSample(candidate.first, formatManager_))
+            used -= size - candidate.first->getMemorySize();
+    }
+}
@@ -0,0 +1,65 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZSAMPLELOADER_H_INCLUDED
+#define SFZSAMPLELOADER_H_INCLUDED
+
+#include "SFZSharedResources.h"
+
+namespace sfzero
+{
+    /** A global singleton that loads and releases sample data on a background thread:
+        SF2 sample data as sounds select presets (see sf2StoreLazy), and sample data of
+        all files to keep within the memory budget (see SharedResources::setMemoryBudget()).
+
+        Program changes only mark the file's resources for an update, so they stay
+        wait-free on the audio thread. Likewise, voices only note when they played a sample.
+        The loader holds on to the resources until no sound uses them anymore, and then
+        releases them on its own thread.
+     */
+
+    class SampleLoader : private juce::Thread
+    {
+    public:
+        SampleLoader();
+        ~SampleLoader();
+
+        juce_DeclareSingleton (SampleLoader, false);
+
+        /** Keeps samples of the resources loaded as their presets are selected, and
+            within the memory budget */
+        void add (SharedResourceBase *resources);
+        
+        /** Applies the memory budget again soon, e.g. after resources were loaded or
+            released. Wait-free. */
+        void requestBudgetCheck() { budgetRequested_.set(1); }
+
+    private:
+        enum { pollInterval = 10 }; // ms between residency updates and checks of requests
+        enum { budgetInterval = 1000 }; // ms between budget checks not requested
+        enum { minResidentTime = 1000 }; // ms a sample played is kept, even beyond the budget
+
+        void run() override;
+        void applyMemoryBudget (const juce::ReferenceCountedArray<SharedResourceBase> &resources, juce::int64 budget);
+
+        juce::CriticalSection lock_;
+        juce::ReferenceCountedArray<SharedResourceBase> resources_;
+        juce::AudioFormatManager formatManager_;
+        juce::Atomic<int> budgetRequested_;
+        juce::uint32 lastBudgetCheck_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleLoader)
+    };
+}
+
+#endif // SFZSAMPLELOADER_H_INCLUDED
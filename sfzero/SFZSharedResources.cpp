@@ -12,8 +12,19 @@
  ***********************************************************************/
 
 #include "SFZSharedResources.h"
+#include "SFZBankCache.h"
 #include "SFZDebug.h"
 #include "SF2Reader.h"
+#include "SF2Sound.h"
+#include "SFZReleasePool.h"
+#include "SFZSampleArena.h"
+#include "SFZSampleData.h"
+#include "SFZSampleLoader.h"
+#include "SFZStreamPool.h"
+
+#if JUCE_MAC || JUCE_IOS || JUCE_LINUX || JUCE_ANDROID
+ #include <sys/mman.h>
+#endif
 
 
 /*********************************************************************************
@@ -38,40 +49,128 @@ sfzero::SharedResourceBase::~SharedResourceBase ()
 
 sfzero::SharedResourcesSFZ::SharedResourcesSFZ (juce::String filename) :
     SharedResourceBase(filename),
-    samples_()
+    samples_(),
+    arenas_()
 {
 }
 
 sfzero::SharedResourcesSFZ::~SharedResourcesSFZ ()
 {
     DBG ("Deleting SharedResourcesSFZ " << getKey());
-    if (SharedResources::getInstanceWithoutCreating() != nullptr)
-        SharedResources::getInstance()->sfzRemove(getKey());
     
-    // All samples share the same buffer, so make sure only the last will be deleted below
-    juce::AudioSampleBuffer *buffer = nullptr;
-    for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
-    {
-        buffer = i.getValue()->detachBuffer();
-    }
-    delete buffer;
-    for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
+    // Buffers refer to the data in the arenas, which are deleted after them unless
+    // shared data of other files is in them
+    for (SampleLookup::Iterator i(samples_); i.next();)
     {
+        delete i.getValue()->detachBuffer();
         delete i.getValue();
     }
+    if (SharedResources::getInstanceWithoutCreating() != nullptr)
+        SharedResources::getInstance()->purgeSampleData();
 }
 
 sfzero::Sample* sfzero::SharedResourcesSFZ::getSample (const juce::String name)
 {
-    juce::ScopedLock sl (lock_);
     return samples_[name];
 }
 
 sfzero::Sample* sfzero::SharedResourcesSFZ::setSample (const juce::String name, sfzero::Sample* sample)
 {
-    juce::ScopedLock sl (lock_);
-    samples_.set(name, sample);
-    return sample;
+    sfzero::Sample *shared = samples_.setIfAbsent(name, sample);
+    if (shared != sample)
+        delete sample;
+    return shared;
+}
+
+namespace
+{
+    // Reads the format of a sample when run first, and its data into the channels
+    // set then when run again, hashing the data for sharing it
+    class SampleLoadJob : public juce::ThreadPoolJob
+    {
+    public:
+        SampleLoadJob (sfzero::Sample *sample, juce::AudioFormatManager *formatManager, int preloadTime, juce::Atomic<int> &numDone) :
+            juce::ThreadPoolJob ("SFZ sample loading"),
+            sample_ (sample), formatManager_ (formatManager), preloadTime_ (preloadTime), numDone_ (numDone),
+            arena_ (), channels_ (), numChannels_ (0), numFrames_ (0), ok_ (false), data_ ()
+        {}
+        
+        JobStatus runJob() override
+        {
+            if (!shouldExit())
+            {
+                if (channels_.isEmpty())
+                {
+                    numFrames_ = sample_->readFormat(formatManager_, preloadTime_, numChannels_);
+                    ok_ = (numFrames_ > 0) && (numChannels_ > 0);
+                }
+                else
+                {
+                    ok_ = sample_->load(formatManager_, preloadTime_, channels_.getRawDataPointer(), numChannels_, numFrames_);
+                    if (ok_)
+                        data_ = new sfzero::SampleData(arena_.get(), channels_, numFrames_, sample_->getBuffer()->getNumSamples());
+                }
+            }
+            ++numDone_;
+            return jobHasFinished;
+        }
+        
+        void setChannels (sfzero::SampleArena *arena, const juce::Array<float*> &channels)
+        {
+            arena_ = arena;
+            channels_ = channels;
+            ok_ = false;
+        }
+        
+        sfzero::Sample *getSample() const { return sample_; }
+        int getNumChannels() const { return numChannels_; }
+        int getNumFrames() const { return numFrames_; }
+        bool isOk() const { return ok_; }
+        sfzero::SampleData *getData() const { return data_.get(); }
+        
+    private:
+        sfzero::Sample *sample_;
+        juce::AudioFormatManager *formatManager_;
+        int preloadTime_;
+        juce::Atomic<int> &numDone_;
+        sfzero::SampleArena::Ptr arena_;
+        juce::Array<float*> channels_;
+        int numChannels_, numFrames_;
+        bool ok_;
+        sfzero::SampleData::Ptr data_;
+    };
+    
+    // Runs the jobs, reporting progress from start to end, and waits until the pool is
+    // done with them. Returns false if cancelled.
+    bool runJobs (juce::ThreadPool &pool, const juce::Array<SampleLoadJob*> &jobs, juce::Atomic<int> &numDone,
+                  double *progressVar, double start, double end, juce::Thread *thread)
+    {
+        static const int progressInterval = 20; // ms
+        
+        numDone = 0;
+        for (SampleLoadJob *job : jobs)
+            pool.addJob(job, false);
+        
+        const double numSamples = juce::jmax(1, jobs.size());
+        while (numDone.get() < jobs.size())
+        {
+            if (progressVar)
+                *progressVar = start + (end - start) * numDone.get() / numSamples;
+            
+            if (thread && thread->threadShouldExit())
+            {
+                pool.removeAllJobs(true, -1);
+                return false;
+            }
+            juce::Thread::sleep(progressInterval);
+        }
+        
+        // A job counts itself done before the pool lets go of it, so it may be added
+        // again only once the pool has
+        for (SampleLoadJob *job : jobs)
+            pool.waitForJobToFinish(job, -1);
+        return true;
+    }
 }
 
 void sfzero::SharedResourcesSFZ::loadSamples (sfzero::Sound *sound,
@@ -87,23 +186,69 @@ void sfzero::SharedResourcesSFZ::loadSamples (sfzero::Sound *sound,
         if (progressVar)
             *progressVar = 0.0;
         
-        double numSamplesLoaded = 1.0, numSamples = samples_.size();
-        for (juce::HashMap<juce::String, Sample*>::Iterator i(samples_); i.next();)
+        // Samples are read by a bounded number of workers, while this thread reports
+        // progress and watches for cancellation. Samples loaded before a cancellation
+        // are skipped when loading again.
+        static const int maxWorkers = 8;
+        static const double formatProgress = 0.1;
+        
+        const int preloadTime = SharedResources::getInstance()->getSFZPreloadTime();
+        juce::OwnedArray<SampleLoadJob> jobs;
+        juce::Atomic<int> numDone (0);
+        for (SampleLookup::Iterator i(samples_); i.next();)
         {
-            sfzero::Sample *sample = i.getValue();
-            bool ok = sample->load(formatManager);
-            if (!ok)
-                sound->addError("failed loading sample \"" + sample->getShortName() + "\"");
-            
-            numSamplesLoaded += 1.0;
-            if (progressVar)
-                *progressVar = numSamplesLoaded / numSamples;
-            
-            if (thread && thread->threadShouldExit())
-                return;
+            if (!i.getValue()->hasData())
+                jobs.add(new SampleLoadJob(i.getValue(), formatManager, preloadTime, numDone));
+        }
+        
+        const int numWorkers = juce::jlimit(1, maxWorkers, juce::jmin(juce::SystemStats::getNumCpus(), jobs.size()));
+        juce::ThreadPool pool (numWorkers);
+        juce::Array<SampleLoadJob*> formatJobs (jobs.begin(), jobs.size());
+        if (!runJobs(pool, formatJobs, numDone, progressVar, 0.0, formatProgress, thread))
+            return;
+        
+        // All sample data goes into one arena, sized by the formats read first
+        size_t arenaSize = 0;
+        for (SampleLoadJob *job : jobs)
+        {
+            if (job->isOk())
+                arenaSize += job->getNumChannels() * sfzero::SampleArena::bytesFor(job->getNumFrames());
+        }
+        juce::Array<SampleLoadJob*> dataJobs;
+        if (arenaSize > 0)
+        {
+            sfzero::SampleArena *arena = arenas_.add(new sfzero::SampleArena(arenaSize));
+            for (SampleLoadJob *job : jobs)
+            {
+                if (!job->isOk())
+                    continue;
+                
+                juce::Array<float*> channels;
+                for (int c = 0; c < job->getNumChannels(); ++c)
+                    channels.add(arena->allocate(job->getNumFrames()));
+                
+                job->setChannels(arena, channels);
+                if (!channels.contains(nullptr))
+                    dataJobs.add(job);
+            }
+        }
+        if (!runJobs(pool, dataJobs, numDone, progressVar, formatProgress, 1.0, thread))
+            return;
+        
+        // Samples of the same content as others, of this file or another, use their data
+        // instead, so their own is released
+        for (SampleLoadJob *job : jobs)
+        {
+            if (!job->isOk())
+                sound->addError("failed loading sample \"" + job->getSample()->getShortName() + "\"");
+            else if (job->getData() != nullptr)
+                job->getSample()->useData(SharedResources::getInstance()->shareSampleData(job->getData()));
         }
         loaded_ = true;
         
+        // Counts toward the memory budget, also if set later
+        sfzero::SampleLoader::getInstance()->add(this);
+        
     } else {
         sound->addUnsupportedOpcode("using shared samples");
     }
@@ -111,6 +256,68 @@ void sfzero::SharedResourcesSFZ::loadSamples (sfzero::Sound *sound,
         *progressVar = 1.0;
 }
 
+juce::int64 sfzero::SharedResourcesSFZ::getMemoryUsage()
+{
+    juce::ScopedLock sl (lock_);
+    juce::int64 bytes = 0;
+    for (SampleLookup::Iterator i(samples_); i.next();)
+    {
+        // Data shared by another sample counts there
+        if (!i.getValue()->usesSharedData())
+            bytes += i.getValue()->getMemorySize();
+    }
+    return bytes;
+}
+
+void sfzero::SharedResourcesSFZ::addEvictableSamples (juce::Array<Sample*> &samples)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // Samples streamed anyway have their head loaded only
+    for (SampleLookup::Iterator i(samples_); i.next();)
+    {
+        if (i.getValue()->hasData() && !i.getValue()->isStreamed())
+            samples.add(i.getValue());
+    }
+}
+
+bool sfzero::SharedResourcesSFZ::evictSample (sfzero::Sample *sample, juce::AudioFormatManager &formatManager)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // Data used by other samples stays, and data evicted is not shared anymore
+    if (sample->getData() != nullptr)
+    {
+        if (!SharedResources::getInstance()->unshareSampleData(sample->getData()))
+            return false;
+        sample->stopSharingData();
+    }
+    
+    // Voices stream the rest of an evicted sample, so it still plays at once
+    sfzero::StreamPool::getInstance();
+    const int preloadTime = juce::jmax(static_cast<int>(evictedPreloadTime), SharedResources::getInstance()->getSFZPreloadTime());
+    if (!sample->reload(&formatManager, preloadTime))
+        return false;
+    sample->setEvicted(true);
+    return true;
+}
+
+void sfzero::SharedResourcesSFZ::reloadSamples (juce::AudioFormatManager &formatManager, juce::Thread *thread)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // A sample still playing from its head is reloaded once its notes have ended
+    for (SampleLookup::Iterator i(samples_); i.next();)
+    {
+        sfzero::Sample *sample = i.getValue();
+        if (sample->isWanted() && !sample->isInUse() && sample->reload(&formatManager))
+            sample->setEvicted(false);
+        
+        if (thread && thread->threadShouldExit())
+            return;
+    }
+}
+
 
 juce::String sfzero::SharedResourcesSFZ::dump()
 {
@@ -120,7 +327,7 @@ juce::String sfzero::SharedResourcesSFZ::dump()
     if (samples_.size() > 0)
     {
         info << samples_.size() << " samples: \n";
-        for (juce::HashMap<juce::String, sfzero::Sample *>::Iterator i(samples_); i.next();)
+        for (SampleLookup::Iterator i(samples_); i.next();)
         {
             info << i.getValue()->dump();
         }
@@ -140,26 +347,45 @@ juce::String sfzero::SharedResourcesSFZ::dump()
 
 sfzero::SharedResourcesSF2::SharedResourcesSF2 (juce::String filename) :
     SharedResourceBase(filename),
-    samplesByRate_ ()
+    storage_ (SharedResources::getInstance()->getSF2SampleStorage()),
+    samplesByRate_ (),
+    samplesByIndex_ (),
+    compressedSamples_ (),
+    sampleDataOffset_ (0),
+    sampleDataLength_ (0),
+    sharedDataSize_ (0),
+    residencyRequested_ (0),
+    cache_ (),
+    presetsLoaded_ (false),
+    sharedData_ (),
+    cachedData_ (),
+    mappedFile_ (),
+    mappedData_ (nullptr),
+    mappedSamples_ (0)
 {
+    const juce::File cacheDirectory (SharedResources::getInstance()->getBankCacheDirectory());
+    if (cacheDirectory != juce::File())
+        cache_.reset(new sfzero::BankCache(cacheDirectory, juce::File(filename), storage_));
 }
 
 sfzero::SharedResourcesSF2::~SharedResourcesSF2 ()
 {
     DBG("Deleting SharedResourcesSF2 " << getKey());
     
-    if (SharedResources::getInstanceWithoutCreating() != nullptr)
-        SharedResources::getInstance()->sf2Remove(getKey());
-    
-    // All samples share the same buffer, so make sure only the last will be deleted below
-    juce::AudioSampleBuffer *buffer = nullptr;
-    for (juce::HashMap<int, sfzero::Sample*>::Iterator i(samplesByRate_); i.next();)
+    // All samples share the same buffer, owned by the shared or cached data
+    for (SampleLookup::Iterator i(samplesByRate_); i.next();)
+    {
+        i.getValue()->detachBuffer();
+        delete i.getValue();
+    }
+    // Samples loaded on demand or decoded have their own buffers
+    for (SampleLookup::Iterator i(samplesByIndex_); i.next();)
     {
-        buffer = i.getValue()->detachBuffer();
+        delete i.getValue()->detachBuffer();
+        delete i.getValue();
     }
-    delete buffer;
-    // Now delete all detached samples
-    for (juce::HashMap<int, sfzero::Sample*>::Iterator i(samplesByRate_); i.next();)
+    // Presets own their regions
+    for (juce::HashMap<int, sfzero::Preset*>::Iterator i(presets_); i.next();)
     {
         delete i.getValue();
     }
@@ -169,10 +395,56 @@ sfzero::SharedResourcesSF2::~SharedResourcesSF2 ()
         delete i.getValue();
     }
 #endif
+    sharedData_ = nullptr;
+    if (SharedResources::getInstanceWithoutCreating() != nullptr)
+        SharedResources::getInstance()->purgeSampleData();
 }
 
 
 
+void sfzero::SharedResourcesSF2::loadPresets (sfzero::SF2Sound *sound)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // Parse presets only once
+    if (!presetsLoaded_)
+    {
+        if (cache_ != nullptr && cache_->readPresets(*this, presetErrors_))
+        {
+            for (const juce::String &error : presetErrors_)
+                sound->addError(error);
+        }
+        else
+        {
+            sfzero::SF2Reader reader(sound, sound->getFile());
+            reader.read();
+            presetErrors_ = sound->getErrors();
+        }
+        
+        for (juce::HashMap<int, sfzero::Preset*>::Iterator i(presets_); i.next();)
+        {
+            i.getValue()->buildRegionTable();
+        }
+        presetsLoaded_ = true;
+        
+    } else {
+        for (const juce::String &error : presetErrors_)
+            sound->addError(error);
+        sound->addUnsupportedOpcode("using shared presets");
+    }
+}
+
+void sfzero::SharedResourcesSF2::addPreset (sfzero::Preset *preset)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // A preset of the same bank and program replaces the previous one
+    sfzero::Preset *previous = presets_[preset->index()];
+    if (previous != preset)
+        delete previous;
+    presets_.set(preset->index(), preset);
+}
+
 void sfzero::SharedResourcesSF2::loadSamples (sfzero::SF2Sound *sound,
                                               juce::AudioFormatManager *formatManager,
                                               double *progressVar,
@@ -184,18 +456,93 @@ void sfzero::SharedResourcesSF2::loadSamples (sfzero::SF2Sound *sound,
     if (!loaded_)
     {
         sfzero::SF2Reader reader(sound, sound->getFile());
-        juce::AudioSampleBuffer *buffer = reader.readSampleData(progressVar, thread);
+        const SF2SampleStorage storage = storage_;
+        juce::AudioSampleBuffer *floatData = nullptr;
         
-        if (buffer)
+        if (storage == sf2StoreLazy)
+        {
+            // Samples of the selected presets are loaded now, others when selected
+            sampleDataLength_ = reader.locateSampleData(sampleDataOffset_);
+            if (sampleDataLength_ > 0)
+            {
+                requestResidencyUpdate();
+                updateResidency(thread);
+                sfzero::SampleLoader::getInstance()->add(this);
+            }
+        }
+        else if (samplesByRate_.size() == 0)
+        {
+            // SF3 with compressed samples only, decoded below
+        }
+        else if (storage == sf2StoreMapped && mapSampleData(reader, sound->getFile()))
+        {
+            // All Samples point into the mapped file
+            for (SampleLookup::Iterator i(samplesByRate_); i.next();)
+            {
+                i.getValue()->setInt16Data(mappedData_, mappedSamples_);
+            }
+        }
+        else if (storage == sf2StoreInt16 || storage == sf2StoreMapped)
+        {
+            juce::HeapBlock<juce::int16> int16Data;
+            int numSamples = reader.readSampleData16(int16Data, progressVar, thread);
+            
+            if (numSamples > 0)
+            {
+                // Data of the same content, read by another file, counts there
+                sfzero::SampleData::Ptr data = new sfzero::SampleData(int16Data, numSamples);
+                sharedData_ = SharedResources::getInstance()->shareSampleData(data);
+                if (sharedData_ == data)
+                    sharedDataSize_ = numSamples * static_cast<juce::int64>(sizeof(juce::int16));
+                
+                // All Samples share the same data
+                for (SampleLookup::Iterator i(samplesByRate_); i.next();)
+                {
+                    i.getValue()->setInt16Data(sharedData_->getInt16Data(), numSamples);
+                }
+            }
+        }
+        else
         {
-            // All Samples share the same buffer
-            for (juce::HashMap<int, sfzero::Sample *>::Iterator i(samplesByRate_); i.next();)
+            juce::AudioSampleBuffer *buffer = (cache_ != nullptr) ? cache_->createSampleBuffer() : nullptr;
+            if (buffer != nullptr)
+            {
+                // Data of the bank cache is mapped, neither counted as used memory nor
+                // shared, as hashing would page it all in
+                cachedData_.reset(buffer);
+            }
+            else if ((buffer = reader.readSampleData(progressVar, thread)) != nullptr)
+            {
+                sfzero::SampleData::Ptr data = new sfzero::SampleData(buffer);
+                sharedData_ = SharedResources::getInstance()->shareSampleData(data);
+                buffer = sharedData_->getBuffer();
+                if (sharedData_ == data)
+                    sharedDataSize_ = buffer->getNumSamples() * static_cast<juce::int64>(sizeof(float));
+            }
+            floatData = buffer;
+            
+            if (buffer)
             {
-                i.getValue()->setBuffer(buffer);
+                // All Samples share the same buffer
+                for (SampleLookup::Iterator i(samplesByRate_); i.next();)
+                {
+                    i.getValue()->setBuffer(buffer);
+                }
             }
         }
+        if (storage != sf2StoreLazy && !decodeSamples(sound, reader, progressVar, thread))
+        {
+            return;
+        }
         loaded_ = true;
         
+        // Compile the cache for the next load, unless this one was complete or cancelled
+        if (cache_ != nullptr && !cache_->isComplete() && !(thread && thread->threadShouldExit()))
+            cache_->write(*this, presetErrors_, floatData);
+        
+        // Counts toward the memory budget, also if set later
+        sfzero::SampleLoader::getInstance()->add(this);
+        
     } else {
         sound->addUnsupportedOpcode("using shared samples");
     }
@@ -203,19 +550,391 @@ void sfzero::SharedResourcesSF2::loadSamples (sfzero::SF2Sound *sound,
         *progressVar = 1.0;
 }
 
-sfzero::Sample* sfzero::SharedResourcesSF2::getSample (double sampleRate)
+bool sfzero::SharedResourcesSF2::mapSampleData (sfzero::SF2Reader &reader, const juce::File &file)
 {
-    juce::ScopedLock sl (lock_);
+#if JUCE_BIG_ENDIAN
+    // Samples are little endian in the file, so they need to be read and swapped
+    juce::ignoreUnused (reader, file);
+    return false;
+#else
+    juce::int64 offset = 0;
+    int numSamples = reader.locateSampleData(offset);
+    if (numSamples <= 0)
+        return false;
+    
+    juce::Range<juce::int64> range (offset, offset + numSamples * static_cast<juce::int64>(sizeof(juce::int16)));
+    mappedFile_.reset (new juce::MemoryMappedFile (file, range, juce::MemoryMappedFile::readOnly, false));
+    
+    // The mapped range starts at a page boundary at or before the requested offset
+    if (mappedFile_->getData() == nullptr || mappedFile_->getRange().getEnd() < range.getEnd())
+    {
+        mappedFile_.reset();
+        return false;
+    }
+    const char *base = static_cast<const char*>(mappedFile_->getData());
+    mappedData_ = reinterpret_cast<const juce::int16*>(base + (offset - mappedFile_->getRange().getStart()));
+    mappedSamples_ = numSamples;
+    return true;
+#endif
+}
+
+void sfzero::SharedResourcesSF2::warmUp (juce::Thread *thread)
+{
+    // Mappings are made while loading and kept until the resources are deleted, so the
+    // pages are touched without the lock, which would block the SampleLoader meanwhile
+    char *data = nullptr;
+    size_t size = 0;
+    {
+        juce::ScopedLock sl (lock_);
+        
+        juce::MemoryMappedFile *mappedFile = mappedFile_.get();
+        if (mappedFile == nullptr && cache_ != nullptr)
+            mappedFile = cache_->getMappedFile();
+        if (mappedFile == nullptr)
+            return;
+        
+        data = static_cast<char*>(mappedFile->getData());
+        size = mappedFile->getSize();
+    }
+    
+#if JUCE_MAC || JUCE_IOS || JUCE_LINUX || JUCE_ANDROID
+    madvise(data, size, MADV_WILLNEED);
+#endif
     
+    // Touch every page, so it is faulted in here rather than on the audio thread
+    const size_t pageSize = static_cast<size_t>(juce::jmax(4096, juce::SystemStats::getPageSize()));
+    volatile char sum = 0;
+    for (size_t i = 0; i < size; i += pageSize)
+    {
+        sum += data[i];
+        if (thread && (i % (1024 * pageSize)) == 0 && thread->threadShouldExit())
+            return;
+    }
+    juce::ignoreUnused(sum);
+}
+
+sfzero::Sample* sfzero::SharedResourcesSF2::getSample (double sampleRate)
+{
     sfzero::Sample *sample = samplesByRate_[static_cast<int>(sampleRate)];
     if (sample == nullptr)
     {
+        sfzero::Sample *created = new sfzero::Sample(sampleRate);
+        sample = samplesByRate_.setIfAbsent(static_cast<int>(sampleRate), created);
+        if (sample != created)
+            delete created;
+    }
+    return sample;
+}
+
+
+sfzero::Sample* sfzero::SharedResourcesSF2::getSample (int sampleIndex, double sampleRate, juce::Range<juce::int64> range, bool compressed)
+{
+    sfzero::Sample *sample = samplesByIndex_[sampleIndex];
+    if (sample == nullptr)
+    {
+        // Samples are created while loading presets, which holds the lock anyway
+        juce::ScopedLock sl (lock_);
+        
         sample = new sfzero::Sample(sampleRate);
-        samplesByRate_.set(static_cast<int>(sampleRate), sample);
+        sample->setSourceRange(range);
+        samplesByIndex_.set(sampleIndex, sample);
+        if (compressed)
+            compressedSamples_.add(sampleIndex);
     }
     return sample;
 }
 
+namespace
+{
+    class SampleDecodeJob : public juce::ThreadPoolJob
+    {
+    public:
+        SampleDecodeJob (sfzero::Sample *sample, juce::MemoryBlock &data, juce::Atomic<int> &numDone) :
+            juce::ThreadPoolJob ("SF3 sample decoding"),
+            sample_ (sample), data_ (), numDone_ (numDone), ok_ (false)
+        {
+            data_.swapWith(data);
+        }
+        
+        JobStatus runJob() override
+        {
+            if (!shouldExit())
+            {
+                juce::AudioSampleBuffer *buffer = sfzero::SF2Reader::decodeCompressedSample(data_.getData(), data_.getSize());
+                ok_ = (buffer != nullptr);
+                if (ok_)
+                    sample_->setBuffer(buffer);
+            }
+            data_.reset();
+            ++numDone_;
+            return jobHasFinished;
+        }
+        
+        sfzero::Sample *getSample() const { return sample_; }
+        bool isOk() const { return ok_; }
+        
+    private:
+        sfzero::Sample *sample_;
+        juce::MemoryBlock data_;
+        juce::Atomic<int> &numDone_;
+        bool ok_;
+    };
+}
+
+bool sfzero::SharedResourcesSF2::decodeSamples (sfzero::SF2Sound *sound,
+                                                sfzero::SF2Reader &reader,
+                                                double *progressVar,
+                                                juce::Thread *thread)
+{
+    // Compressed samples (SF3) are read in file order on this thread, and decoded by a
+    // bounded number of workers meanwhile. Samples decoded before a cancellation, or
+    // read from the bank cache, are skipped when loading again.
+    static const int maxWorkers = 8;
+    static const int progressInterval = 20; // ms
+    
+    juce::Array<int> indexes;
+    for (int index : compressedSamples_)
+    {
+        if (!samplesByIndex_[index]->hasData())
+            indexes.add(index);
+    }
+    if (indexes.isEmpty())
+        return true;
+    
+    juce::FileInputStream stream ((juce::File(filename_)));
+    sampleDataLength_ = reader.locateSampleData(sampleDataOffset_);
+    if (!stream.openedOk() || sampleDataLength_ <= 0)
+        return true;
+    
+    if (progressVar)
+        *progressVar = 0.0;
+    
+    juce::OwnedArray<SampleDecodeJob> jobs;
+    juce::Atomic<int> numDone (0);
+    const int numWorkers = juce::jlimit(1, maxWorkers, juce::jmin(juce::SystemStats::getNumCpus(), indexes.size()));
+    juce::ThreadPool pool (numWorkers);
+    
+    for (int index : indexes)
+    {
+        sfzero::Sample *sample = samplesByIndex_[index];
+        juce::MemoryBlock data;
+        if (!readCompressedRange(stream, sample->getSourceRange(), data))
+        {
+            sound->addError("failed reading sample \"" + sample->name + "\"");
+            continue;
+        }
+        SampleDecodeJob *job = jobs.add(new SampleDecodeJob(sample, data, numDone));
+        pool.addJob(job, false);
+        
+        if (thread && thread->threadShouldExit())
+        {
+            pool.removeAllJobs(true, -1);
+            return false;
+        }
+    }
+    
+    const double numSamples = juce::jmax(1, jobs.size());
+    while (numDone.get() < jobs.size())
+    {
+        if (progressVar)
+            *progressVar = numDone.get() / numSamples;
+        
+        if (thread && thread->threadShouldExit())
+        {
+            pool.removeAllJobs(true, -1);
+            return false;
+        }
+        juce::Thread::sleep(progressInterval);
+    }
+    
+    for (SampleDecodeJob *job : jobs)
+    {
+        if (!job->isOk())
+            sound->addError("failed decoding sample \"" + job->getSample()->name + "\"");
+    }
+    return true;
+}
+
+void sfzero::SharedResourcesSF2::setPrefetch (const juce::Array<int> &presetIndexes)
+{
+    juce::ScopedLock sl (lock_);
+    prefetch_ = presetIndexes;
+    requestResidencyUpdate();
+}
+
+void sfzero::SharedResourcesSF2::updateResidency (juce::Thread *thread)
+{
+    if (residencyRequested_.exchange(0) == 0)
+        return;
+    
+    juce::ScopedLock sl (lock_);
+    
+    if (storage_ != sf2StoreLazy || sampleDataLength_ <= 0)
+        return;
+    
+    juce::SortedSet<sfzero::Sample*> needed;
+    for (juce::HashMap<int, sfzero::Preset*>::Iterator i(presets_); i.next();)
+    {
+        sfzero::Preset *preset = i.getValue();
+        if (preset->numSelections.get() > 0 || prefetch_.contains(preset->index()))
+        {
+            for (sfzero::Region *region : preset->regions)
+                needed.add(region->sample);
+        }
+    }
+    
+    std::unique_ptr<juce::FileInputStream> stream;
+    for (SampleLookup::Iterator i(samplesByIndex_); i.next();)
+    {
+        sfzero::Sample *sample = i.getValue();
+        if (needed.contains(sample))
+        {
+            if (!sample->hasData() && !sample->isEvicted())
+            {
+                if (stream == nullptr)
+                {
+                    stream.reset(new juce::FileInputStream(juce::File(filename_)));
+                    if (!stream->openedOk())
+                        return;
+                }
+                loadSample(*stream, i.getKey(), sample);
+            }
+        }
+        else if (sample->hasData() && !sample->releaseBuffer())
+        {
+            // Still playing, release later
+            requestResidencyUpdate();
+        }
+        else
+        {
+            // Loaded normally when selected again
+            sample->setEvicted(false);
+        }
+        
+        if (thread && thread->threadShouldExit())
+        {
+            requestResidencyUpdate();
+            return;
+        }
+    }
+}
+
+juce::int64 sfzero::SharedResourcesSF2::getMemoryUsage()
+{
+    juce::ScopedLock sl (lock_);
+    juce::int64 bytes = sharedDataSize_;
+    for (SampleLookup::Iterator i(samplesByIndex_); i.next();)
+    {
+        bytes += i.getValue()->getMemorySize();
+    }
+    return bytes;
+}
+
+void sfzero::SharedResourcesSF2::addEvictableSamples (juce::Array<Sample*> &samples)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // Evicted samples are read from the file again, so not before it was located
+    if (sampleDataLength_ <= 0)
+        return;
+    
+    for (SampleLookup::Iterator i(samplesByIndex_); i.next();)
+    {
+        if (i.getValue()->hasData())
+            samples.add(i.getValue());
+    }
+}
+
+bool sfzero::SharedResourcesSF2::evictSample (sfzero::Sample *sample, juce::AudioFormatManager &formatManager)
+{
+    juce::ignoreUnused(formatManager);
+    juce::ScopedLock sl (lock_);
+    
+    if (!sample->releaseBuffer())
+        return false;
+    sample->setEvicted(true);
+    return true;
+}
+
+void sfzero::SharedResourcesSF2::reloadSamples (juce::AudioFormatManager &formatManager, juce::Thread *thread)
+{
+    juce::ignoreUnused(formatManager);
+    juce::ScopedLock sl (lock_);
+    
+    std::unique_ptr<juce::FileInputStream> stream;
+    for (SampleLookup::Iterator i(samplesByIndex_); i.next();)
+    {
+        sfzero::Sample *sample = i.getValue();
+        if (sample->isWanted() && !sample->hasData())
+        {
+            if (stream == nullptr)
+            {
+                stream.reset(new juce::FileInputStream(juce::File(filename_)));
+                if (!stream->openedOk())
+                    return;
+            }
+            if (loadSample(*stream, i.getKey(), sample))
+                sample->setEvicted(false);
+        }
+        
+        if (thread && thread->threadShouldExit())
+            return;
+    }
+}
+
+bool sfzero::SharedResourcesSF2::loadSample (juce::FileInputStream &stream, int sampleIndex, sfzero::Sample *sample)
+{
+    juce::AudioSampleBuffer *buffer = nullptr;
+    if (compressedSamples_.contains(sampleIndex))
+    {
+        juce::MemoryBlock data;
+        if (readCompressedRange(stream, sample->getSourceRange(), data))
+            buffer = sfzero::SF2Reader::decodeCompressedSample(data.getData(), data.getSize());
+    }
+    else
+    {
+        buffer = readSampleRange(stream, sample->getSourceRange());
+    }
+    if (buffer == nullptr)
+        return false;
+    sample->setBuffer(buffer);
+    return true;
+}
+
+juce::AudioSampleBuffer *sfzero::SharedResourcesSF2::readSampleRange (juce::FileInputStream &stream, juce::Range<juce::int64> range)
+{
+    // Parts of the range outside of the sample data, e.g. guard frames at the end, are zeros
+    const int length = static_cast<int>(range.getLength());
+    const int start = static_cast<int>(juce::jlimit<juce::int64>(0, sampleDataLength_, range.getStart()));
+    const int end = static_cast<int>(juce::jlimit<juce::int64>(start, sampleDataLength_, range.getEnd()));
+    
+    juce::AudioSampleBuffer *buffer = new juce::AudioSampleBuffer(1, length);
+    buffer->clear();
+    
+    juce::HeapBlock<juce::int16> data (end - start);
+    stream.setPosition(sampleDataOffset_ + start * static_cast<juce::int64>(sizeof(juce::int16)));
+    const int bytesRead = stream.read(data, (end - start) * static_cast<int>(sizeof(juce::int16)));
+    const int samplesRead = juce::jmax(0, bytesRead) / static_cast<int>(sizeof(juce::int16));
+    
+    if (samplesRead > 0)
+        sfzero::SF2Reader::convertInt16ToFloat(buffer->getWritePointer(0, start - static_cast<int>(range.getStart())), data, samplesRead);
+    return buffer;
+}
+
+bool sfzero::SharedResourcesSF2::readCompressedRange (juce::FileInputStream &stream, juce::Range<juce::int64> range, juce::MemoryBlock &data)
+{
+    // The range is in bytes of the sample data
+    const juce::int64 numBytes = sampleDataLength_ * static_cast<juce::int64>(sizeof(juce::int16));
+    const juce::int64 start = juce::jlimit<juce::int64>(0, numBytes, range.getStart());
+    const juce::int64 end = juce::jlimit<juce::int64>(start, numBytes, range.getEnd());
+    if (end <= start)
+        return false;
+    
+    data.setSize(static_cast<size_t>(end - start));
+    stream.setPosition(sampleDataOffset_ + start);
+    return stream.read(data.getData(), static_cast<int>(end - start)) == static_cast<int>(end - start);
+}
+
 
 /*********************************************************************************
  *    SharedResources
@@ -225,59 +944,196 @@ juce_ImplementSingleton (sfzero::SharedResources)
 
 sfzero::SharedResources::SharedResources () :
     lock_ (),
+    sf2Storage_ (sf2StoreFloat),
+    sfzPreloadTime_ (0),
+    memoryBudget_ (0),
+    bankCacheDirectory_ (),
     sfz_ (),
-    sf2_ ()
+    sf2_ (),
+    sampleData_ ()
 {
 }
 
 sfzero::SharedResources::~SharedResources ()
 {
     DBG("Deleting SharedResources");
+    // Resources still used by others are deleted when they drop them
+    for (SharedResourcesSFZ::Lookup::Iterator i(sfz_); i.next();)
+    {
+        i.getValue()->decReferenceCount();
+    }
+    for (SharedResourcesSF2::Lookup::Iterator i(sf2_); i.next();)
+    {
+        i.getValue()->decReferenceCount();
+    }
+    for (juce::HashMap<juce::String, sfzero::SampleData*>::Iterator i(sampleData_); i.next();)
+    {
+        i.getValue()->decReferenceCount();
+    }
     clearSingletonInstance();
 }
 
-sfzero::SharedResourcesSFZ* sfzero::SharedResources::sfzResources (const juce::File& filename)
+void sfzero::SharedResources::shutdown ()
 {
-    juce::ScopedLock sl (lock_);
+    // The loader may start streaming, and sounds released need the shared resources
+    sfzero::SampleLoader::deleteInstance();
+    sfzero::ReleasePool::deleteInstance();
+    sfzero::StreamPool::deleteInstance();
+    deleteInstance();
+}
+
+void sfzero::SharedResources::setSFZPreloadTime (int milliseconds)
+{
+    // Start streaming before the first streamed sample is played
+    if (milliseconds > 0)
+        sfzero::StreamPool::getInstance();
+    sfzPreloadTime_ = milliseconds;
+}
+
+void sfzero::SharedResources::setMemoryBudget (juce::int64 bytes)
+{
+    // Evicted SFZ samples are streamed
+    if (bytes > 0)
+        sfzero::StreamPool::getInstance();
+    memoryBudget_ = bytes;
     
+    // Files loaded before are held by the loader already
+    if (sfzero::SampleLoader *loader = sfzero::SampleLoader::getInstanceWithoutCreating())
+        loader->requestBudgetCheck();
+}
+
+void sfzero::SharedResources::setBankCacheDirectory (const juce::File &directory)
+{
+    juce::ScopedLock sl (lock_);
+    bankCacheDirectory_ = directory;
+}
+
+juce::File sfzero::SharedResources::getBankCacheDirectory () const
+{
+    juce::ScopedLock sl (lock_);
+    return bankCacheDirectory_;
+}
+
+sfzero::SharedResourcesSFZ::Ptr sfzero::SharedResources::sfzResources (const juce::File& filename)
+{
     juce::String fn (filename.getFullPathName());
+    
+    // The reference is taken while locked, so releaseUnused() can't drop the last one
+    // meanwhile. Resources in the table are referenced by it, too.
+    juce::ScopedLock sl (lock_);
     SharedResourcesSFZ* samples = sfz_[fn];
     if (samples == nullptr)
     {
         samples = new SharedResourcesSFZ(fn);
+        samples->incReferenceCount();
         sfz_.set(fn, samples);
     }
     return samples;
 }
 
-sfzero::SharedResourcesSF2* sfzero::SharedResources::sf2Resources (const juce::File& filename)
+sfzero::SharedResourcesSF2::Ptr sfzero::SharedResources::sf2Resources (const juce::File& filename)
 {
-    juce::ScopedLock sl (lock_);
-    
     juce::String fn (filename.getFullPathName());
+    
+    juce::ScopedLock sl (lock_);
     SharedResourcesSF2* samples = sf2_[fn];
     if (samples == nullptr)
     {
         samples = new SharedResourcesSF2(fn);
+        samples->incReferenceCount();
         sf2_.set(fn, samples);
     }
     return samples;
 }
 
-void sfzero::SharedResources::sfzRemove (const juce::File& filename)
+void sfzero::SharedResources::releaseUnused ()
 {
-    juce::ScopedLock sl (lock_);
-    sfz_.remove (filename.getFullPathName());
+    // Resources are deleted when "unused" goes out of scope, after the lock is exited.
+    // They are out of the tables then, so no one gets a reference to them anymore.
+    juce::ReferenceCountedArray<SharedResourceBase> unused;
+    {
+        juce::ScopedLock sl (lock_);
+        
+        juce::StringArray sfzUnused, sf2Unused;
+        for (SharedResourcesSFZ::Lookup::Iterator i(sfz_); i.next();)
+        {
+            if (i.getValue()->getReferenceCount() == 1)
+                sfzUnused.add(i.getKey());
+        }
+        for (SharedResourcesSF2::Lookup::Iterator i(sf2_); i.next();)
+        {
+            if (i.getValue()->getReferenceCount() == 1)
+                sf2Unused.add(i.getKey());
+        }
+        for (const juce::String &key : sfzUnused)
+        {
+            SharedResourcesSFZ *samples = sfz_[key];
+            unused.add(samples);
+            sfz_.remove(key);
+            samples->decReferenceCount();
+        }
+        for (const juce::String &key : sf2Unused)
+        {
+            SharedResourcesSF2 *samples = sf2_[key];
+            unused.add(samples);
+            sf2_.remove(key);
+            samples->decReferenceCount();
+        }
+    }
 }
 
-void sfzero::SharedResources::sf2Remove (const juce::File& filename)
+sfzero::SampleData::Ptr sfzero::SharedResources::shareSampleData (sfzero::SampleData *data)
 {
-    juce::ScopedLock sl (lock_);
-    sf2_.remove (filename.getFullPathName());
+    sfzero::SampleData::Ptr existing;
+    {
+        juce::ScopedLock sl (lock_);
+        existing = sampleData_[data->getKey()];
+        if (existing == nullptr)
+        {
+            data->incReferenceCount();
+            sampleData_.set(data->getKey(), data);
+            return data;
+        }
+    }
+    // Comparing may take a while, so it doesn't lock. Data of the same key but another
+    // content is not shared.
+    if (existing.get() != data && existing->hasSameData(*data))
+        return existing;
+    return data;
 }
 
+bool sfzero::SharedResources::unshareSampleData (sfzero::SampleData *data)
+{
+    juce::ScopedLock sl (lock_);
+    
+    // Only the caller uses the data if no one else has a reference. New users get one
+    // from here while locked, so none can meanwhile.
+    const bool registered = (sampleData_[data->getKey()] == data);
+    const int numUsers = data->getReferenceCount() - (registered ? 1 : 0);
+    if (numUsers > 1)
+        return false;
+    if (registered)
+    {
+        sampleData_.remove(data->getKey());
+        data->decReferenceCount();
+    }
+    return true;
+}
 
-
-
-
-
+void sfzero::SharedResources::purgeSampleData ()
+{
+    juce::ScopedLock sl (lock_);
+    
+    juce::StringArray unused;
+    for (juce::HashMap<juce::String, sfzero::SampleData*>::Iterator i(sampleData_); i.next();)
+    {
+        if (i.getValue()->getReferenceCount() == 1)
+            unused.add(i.getKey());
+    }
+    for (const juce::String &key : unused)
+    {
+        sfzero::SampleData *data = sampleData_[key];
+        sampleData_.remove(key);
+        data->decReferenceCount();
+    }
+}
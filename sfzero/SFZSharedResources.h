@@ -15,17 +15,35 @@
 #define SFZSHAREDRESOURCES_H_INCLUDED
 
 #include "SFZCommon.h"
+#include "SFZExtensions.h"
+#include "SFZLookupTable.h"
 #include "SFZSample.h"
+#include "SFZSampleData.h"
 
 /*  SharedResourcesSFZ, SharedResourcesSF2 are global singeltons that hold
     sample data of a single SFZ/SF2 file that can be used by multiple 
-    instances of Sound/SF2Sound */
+    instances of Sound/SF2Sound. SharedResourcesSF2 holds the file's presets
+    and regions as well, so these are parsed only once. Lookups of samples don't
+    lock, and lookups of the resources of a file lock only briefly, so they never
+    wait for a file being loaded by another thread. Sample data of the same content
+    is shared by all files, see SharedResources::shareSampleData(). */
 
 namespace sfzero
 {
     
+    class BankCache;
     class Sound;
     class SF2Sound;
+    class SF2Reader;
+    
+    /** How SF2 sample data is kept in memory */
+    enum SF2SampleStorage
+    {
+        sf2StoreFloat = 0,  // converted to float on load, twice the size of the file's sample data
+        sf2StoreInt16,      // as stored in the file, converted by the voices while rendering
+        sf2StoreMapped,     // like sf2StoreInt16, but memory mapped from the file instead of read
+        sf2StoreLazy        // converted to float per sample, for selected presets only (see SharedResourcesSF2::updateResidency())
+    };
     
     class SharedResourceBase : public juce::ReferenceCountedObject
     {
@@ -36,6 +54,25 @@ namespace sfzero
         
         juce::String& getKey() { return filename_; };
         
+        // Memory management of sample data, see SharedResources::setMemoryBudget().
+        // Called by the SampleLoader on its thread.
+        
+        /** Bytes of sample data held in memory */
+        virtual juce::int64 getMemoryUsage() = 0;
+        
+        /** Adds the samples whose data can be evicted */
+        virtual void addEvictableSamples (juce::Array<Sample*> &samples) = 0;
+        
+        /** Evicts the data of a sample added above, down to a streamed head or to nothing.
+            Returns false if it is in use. */
+        virtual bool evictSample (Sample *sample, juce::AudioFormatManager &formatManager) = 0;
+        
+        /** Reloads evicted samples that were played since */
+        virtual void reloadSamples (juce::AudioFormatManager &formatManager, juce::Thread *thread) = 0;
+        
+        /** Loads or releases samples as presets are selected, if supported */
+        virtual void updateResidency (juce::Thread *thread = nullptr) { juce::ignoreUnused(thread); }
+        
     protected:
         juce::CriticalSection lock_;
         juce::String filename_;
@@ -52,12 +89,16 @@ namespace sfzero
     public:
         
         typedef juce::ReferenceCountedObjectPtr<SharedResourcesSFZ> Ptr;
-        typedef juce::HashMap<juce::String, SharedResourcesSFZ*> Lookup;
+        typedef LookupTable<juce::String, SharedResourcesSFZ*> Lookup;
+        typedef LookupTable<juce::String, Sample*> SampleLookup;
         
         SharedResourcesSFZ (juce::String filename);
         virtual ~SharedResourcesSFZ ();
         
         Sample* getSample (const juce::String name);
+        
+        /** Takes ownership of the sample. If another thread set a sample of that name
+            first, deletes the sample and returns the other one. */
         Sample* setSample (const juce::String name, Sample* sample);
         
         void loadSamples (Sound *sound,
@@ -67,8 +108,19 @@ namespace sfzero
         
         juce::String dump();
         
+        juce::int64 getMemoryUsage() override;
+        void addEvictableSamples (juce::Array<Sample*> &samples) override;
+        bool evictSample (Sample *sample, juce::AudioFormatManager &formatManager) override;
+        void reloadSamples (juce::AudioFormatManager &formatManager, juce::Thread *thread) override;
+        
     private:
-        juce::HashMap<juce::String, Sample*> samples_;
+        // Milliseconds of an evicted sample kept in memory, unless a longer preload time is set
+        enum { evictedPreloadTime = 500 };
+        
+        SampleLookup samples_;
+        // Sample data, in a single arena unless loading was cancelled and resumed. Samples
+        // of other files may share data in it, so it is kept as long as they do.
+        juce::ReferenceCountedArray<SampleArena> arenas_;
         
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedResourcesSFZ)
     };
@@ -83,17 +135,69 @@ namespace sfzero
     public:
         
         typedef juce::ReferenceCountedObjectPtr<SharedResourcesSF2> Ptr;
-        typedef juce::HashMap<juce::String, SharedResourcesSF2*> Lookup;
+        typedef LookupTable<juce::String, SharedResourcesSF2*> Lookup;
+        typedef LookupTable<int, Sample*> SampleLookup;
         
         SharedResourcesSF2 (juce::String filename);
         virtual ~SharedResourcesSF2 ();
         
         Sample* getSample (double sampleRate);
         
+        /** With sf2StoreLazy or if compressed (SF3), the sample of a shdr record, which covers
+            range of the file's sample data. Positions of its regions are relative to the start
+            of the range. The range of a compressed sample is in bytes, not samples. */
+        Sample* getSample (int sampleIndex, double sampleRate, juce::Range<juce::int64> range, bool compressed = false);
+        
+        /** Samples of shdr records, see above */
+        const SampleLookup &getSamplesByIndex() const { return samplesByIndex_; }
+        bool isCompressed (int sampleIndex) const { return compressedSamples_.contains(sampleIndex); }
+        
+        /** Storage of the sample data, as set when the resources were created */
+        SF2SampleStorage getStorage() const { return storage_; }
+        
+        /** Parses presets and regions of the file, if not done yet by another sound, or
+            reads them from the bank cache. Errors of parsing are added to each sound
+            loading the presets. */
+        void loadPresets (SF2Sound *sound);
+        
+        /** Presets are read-only once loaded, so these need no lock (and are realtime-safe)
+            after loadPresets() returned. */
+        Preset* getPreset (int index) const { return presets_[index]; }
+        const juce::HashMap<int, Preset*> &getPresets() const { return presets_; }
+        
+        /** Takes ownership of the preset. Used by SF2Reader while loading presets. */
+        void addPreset (Preset *preset);
+        
         void loadSamples (SF2Sound *sound,
                           juce::AudioFormatManager *formatManager,
                           double *progressVar,
                           juce::Thread *thread);
+        
+        /** With sf2StoreMapped, or sample data read from the bank cache, pages in all
+            sample data now, so the first notes do not wait for the disk. Optional, call
+            on a background thread. */
+        void warmUp (juce::Thread *thread = nullptr);
+        
+        /** With sf2StoreLazy, presets (see ProgramSelection::index()) whose samples are kept
+            loaded while not selected by any sound, so switching to them plays at once */
+        void setPrefetch (const juce::Array<int> &presetIndexes);
+        
+        /** Asks for an update of loaded samples, after a sound selected another preset.
+            Wait-free. */
+        void requestResidencyUpdate() { residencyRequested_.set(1); }
+        
+        /** With sf2StoreLazy and if requested, loads the samples of presets selected by
+            sounds or prefetched, and releases all others not playing. Called by the
+            SampleLoader on its thread. Samples evicted to save memory are skipped until
+            played again, see reloadSamples(). */
+        void updateResidency (juce::Thread *thread = nullptr) override;
+        
+        /** Samples loaded on demand or decoded (SF3) can be evicted to nothing. Shared
+            sample data can not, but counts as memory used. */
+        juce::int64 getMemoryUsage() override;
+        void addEvictableSamples (juce::Array<Sample*> &samples) override;
+        bool evictSample (Sample *sample, juce::AudioFormatManager &formatManager) override;
+        void reloadSamples (juce::AudioFormatManager &formatManager, juce::Thread *thread) override;
 
 #if JUCE_DEBUG
         juce::String* sampleNameAt (SamplePosition offset)
@@ -106,7 +210,33 @@ namespace sfzero
         juce::HashMap<SamplePosition, juce::String*> sampleNamesByOffset_; // for debugging only
 #endif
     private:
-        juce::HashMap<int, Sample*> samplesByRate_;
+        SF2SampleStorage storage_;
+        SampleLookup samplesByRate_;
+        // With sf2StoreLazy or SF3: samples by shdr record, and where the sample data is in the file
+        SampleLookup samplesByIndex_;
+        juce::SortedSet<int> compressedSamples_;
+        juce::Array<int> prefetch_;
+        juce::int64 sampleDataOffset_;
+        int sampleDataLength_;
+        juce::int64 sharedDataSize_;
+        juce::Atomic<int> residencyRequested_;
+        std::unique_ptr<BankCache> cache_;
+        juce::HashMap<int, Preset*> presets_;
+        juce::StringArray presetErrors_;
+        bool presetsLoaded_;
+        // Float or int16 data read from the file, shared with files of the same content
+        SampleData::Ptr sharedData_;
+        // Float data mapped from the bank cache
+        std::unique_ptr<juce::AudioSampleBuffer> cachedData_;
+        std::unique_ptr<juce::MemoryMappedFile> mappedFile_;
+        const juce::int16 *mappedData_;
+        int mappedSamples_;
+        
+        bool mapSampleData (SF2Reader &reader, const juce::File &file);
+        bool decodeSamples (SF2Sound *sound, SF2Reader &reader, double *progressVar, juce::Thread *thread);
+        bool loadSample (juce::FileInputStream &stream, int sampleIndex, Sample *sample);
+        juce::AudioSampleBuffer *readSampleRange (juce::FileInputStream &stream, juce::Range<juce::int64> range);
+        bool readCompressedRange (juce::FileInputStream &stream, juce::Range<juce::int64> range, juce::MemoryBlock &data);
         
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedResourcesSF2)
     };
@@ -125,16 +255,70 @@ namespace sfzero
         
         juce_DeclareSingleton (SharedResources, false);
         
-        SharedResourcesSFZ* sfzResources (const juce::File& filename);
-        SharedResourcesSF2* sf2Resources (const juce::File& filename);
+        /** Stops the background threads of the module and deletes all global singletons:
+            first the SampleLoader, then the ReleasePool, which deletes the sounds it still
+            holds, then the StreamPool and finally the SharedResources. Call once when the
+            host exits, after all Synths and sounds were deleted. */
+        static void shutdown();
+        
+        /** The resources of a file, created if not used yet. SharedResources keep a
+            reference to them, dropped by releaseUnused(), so a reference handed out
+            here is never one to resources being deleted. */
+        SharedResourcesSFZ::Ptr sfzResources (const juce::File& filename);
+        SharedResourcesSF2::Ptr sf2Resources (const juce::File& filename);
+        
+        /** Deletes the resources of files no longer used by anyone else. Called after
+            dropping a reference that may be the last one but for SharedResources'. */
+        void releaseUnused();
+        
+        /** Storage of SF2 files loaded from now on. Default is sf2StoreFloat. */
+        void setSF2SampleStorage (SF2SampleStorage storage) { sf2Storage_ = storage; }
+        SF2SampleStorage getSF2SampleStorage() const { return static_cast<SF2SampleStorage>(sf2Storage_.get()); }
+        
+        /** Milliseconds of each SFZ sample kept in memory for files loaded from now on.
+            The rest of longer samples is streamed from disk while playing, see StreamPool.
+            Default is 0, which loads samples completely. */
+        void setSFZPreloadTime (int milliseconds);
+        int  getSFZPreloadTime() const { return sfzPreloadTime_.get(); }
+        
+        /** Bytes of sample data all files, loaded before or after, may keep in memory
+            together. Beyond that, the SampleLoader evicts the data of the samples played
+            least recently: SFZ samples down to a head streamed from disk (see
+            setSFZPreloadTime()), SF2 samples loaded on demand or decoded to nothing. Evicted data is reloaded in
+            the background once played again. Samples played within the last second and
+            shared SF2 sample data are not evicted, but count. Default is 0, which sets
+            no limit. */
+        void setMemoryBudget (juce::int64 bytes);
+        juce::int64 getMemoryBudget() const { return memoryBudget_.get(); }
+        
+        /** Directory of compiled caches (see BankCache) of SF2 files loaded from now on.
+            Default is none, which parses and converts the files on every load. */
+        void setBankCacheDirectory (const juce::File &directory);
+        juce::File getBankCacheDirectory() const;
+        
+        /** Returns sample data of the same content as data, loaded before by any file,
+            or data itself, which is then shared from now on. Content is compared by the
+            key of the data, and byte by byte if that matches. */
+        SampleData::Ptr shareSampleData (SampleData *data);
+        
+        /** Stops sharing data, so its holder may change it. Returns false if others
+            use it, too. */
+        bool unshareSampleData (SampleData *data);
         
-        void sfzRemove (const juce::File& filename);
-        void sf2Remove (const juce::File& filename);
+        /** Forgets shared sample data no longer used by any file. Called when the
+            resources of a file are deleted. */
+        void purgeSampleData();
         
     private:
         juce::CriticalSection lock_;
+        juce::Atomic<int> sf2Storage_;
+        juce::Atomic<int> sfzPreloadTime_;
+        juce::Atomic<juce::int64> memoryBudget_;
+        juce::File bankCacheDirectory_;
         SharedResourcesSFZ::Lookup sfz_;
         SharedResourcesSF2::Lookup sf2_;
+        // Referenced sample data by key, see shareSampleData()
+        juce::HashMap<juce::String, SampleData*> sampleData_;
         
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedResources)
     };
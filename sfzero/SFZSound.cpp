@@ -24,7 +24,8 @@ Sound::Sound (const File &fileIn, int channel) :
     SynthesiserSound(),
     channel_(channel),
     selection_(0,0),
-    file_(fileIn)
+    file_(fileIn),
+    regionTable_(nullptr)
 {
     selection_.name = fileIn.getFileName();
 }
@@ -38,6 +39,11 @@ Sound::~Sound()
         regions_.set(i, nullptr);
     }
     sfzSamples_ = nullptr;
+    
+    // The resources of the file are deleted if this was the last sound using them
+    // (SF2Sound dropped its own before)
+    if (SharedResources::getInstanceWithoutCreating() != nullptr)
+        SharedResources::getInstance()->releaseUnused();
 }
 
 SharedResourcesSFZ::Ptr Sound::sharedSamples()
@@ -83,8 +89,8 @@ Sample *Sound::addSample (String path, String defaultPath)
     Sample *sample = sharedSamples()->getSample(samplePath);
     if (sample == nullptr)
     {
-        sample = new Sample(sampleFile);
-        sharedSamples()->setSample(samplePath, sample);
+        // Another sound of the same file may add the sample meanwhile
+        sample = sharedSamples()->setSample(samplePath, new Sample(sampleFile));
     }
     return sample;
 }
@@ -107,6 +113,7 @@ void Sound::loadRegions()
     Reader reader(this);
     
     reader.read(file_);
+    updateRegionIndex();
 }
 
 void Sound::loadSamples (AudioFormatManager *formatManager,
@@ -118,11 +125,13 @@ void Sound::loadSamples (AudioFormatManager *formatManager,
 
 Region *Sound::getRegionFor (int note, int velocity, Region::Trigger trigger)
 {
-    int numRegions = regions_.size();
-    
-    for (int i = 0; i < numRegions; ++i)
+    RegionTable *table = regionTable_.get();
+    if (table)
+    {
+        return table->getRegionFor(note, velocity, trigger);
+    }
+    for (Region *region : regions_)
     {
-        Region *region = regions_[i];
         if (region->matches(note, velocity, trigger))
         {
             return region;
@@ -131,14 +140,33 @@ Region *Sound::getRegionFor (int note, int velocity, Region::Trigger trigger)
     return nullptr;
 }
 
+Region * const *Sound::getRegionCandidates (int note, int velocity, int &numCandidates)
+{
+    RegionTable *table = regionTable_.get();
+    if (table)
+    {
+        return table->getCandidates(note, velocity, numCandidates);
+    }
+    // No table yet
+    numCandidates = regions_.size();
+    return regions_.getRawDataPointer();
+}
+
+void Sound::updateRegionIndex ()
+{
+    selectRegionTable(regionTables_.add(new RegionTable(regions_.getRawDataPointer(), regions_.size())));
+}
+
 int Sound::getNumRegions()
 {
-    return regions_.size();
+    RegionTable *table = regionTable_.get();
+    return table ? table->size() : regions_.size();
 }
 
 Region *Sound::regionAt (int index)
 {
-    return regions_[index];
+    RegionTable *table = regionTable_.get();
+    return table ? (*table)[index] : regions_[index];
 }
 
 
@@ -202,12 +230,13 @@ String Sound::dump()
         info << "no warnings.\n";
     }
     
-    if (regions_.size() > 0)
+    const int numRegions = getNumRegions();
+    if (numRegions > 0)
     {
-        info << regions_.size() << " regions: \n";
-        for (int i = 0; i < regions_.size(); ++i)
+        info << numRegions << " regions: \n";
+        for (int i = 0; i < numRegions; ++i)
         {
-            info << regions_[i]->dump();
+            info << regionAt(i)->dump();
         }
     }
     else
@@ -48,6 +48,18 @@ namespace sfzero
         Region *getRegionFor (int note, int velocity, Region::Trigger trigger = Region::attack);
         Region *regionAt (int index);
         
+        /** Regions whose key and velocity ranges may include note and velocity, in region
+            order. These still need to be checked with Region::matches(). */
+        Region * const *getRegionCandidates (int note, int velocity, int &numCandidates);
+        
+        /** Rebuilds the table behind getRegionFor() and getRegionCandidates() from the
+            regions. Call after changing the regions, on a non-realtime thread. Until the
+            first call, lookups scan all regions. */
+        void updateRegionIndex ();
+        
+        /** Regions of the selected program, or nullptr if no table was built yet */
+        RegionTable *getRegionTable () { return regionTable_.get(); }
+        
         // Loading & building the sound
         virtual void loadRegions ();
         virtual void loadSamples (juce::AudioFormatManager *formatManager,
@@ -64,20 +76,31 @@ namespace sfzero
         juce::String dump();
         
     protected:
-        friend class Synth;
-        // program selection must run under lock protection from Synth
+        friend class SynthBase;
+        friend class Channel;
+        // program selection must run under lock protection from Synth or MultiSynth
         virtual int               getProgramCount(int bank);
         virtual juce::String      getProgramName (const ProgramSelection& selection);
         virtual ProgramSelection& getProgramSelection ();
         virtual void              setProgramSelection (const ProgramSelection& selection);
         virtual ProgramList*      getProgramList();
         
+        /** Makes lookups use the table, which must outlive the sound. Wait-free, so this
+            can be called on the audio thread. */
+        void selectRegionTable (RegionTable *table) { regionTable_.set(table); }
+        
         int channel_;
         ProgramSelection selection_;
         juce::File file_;
         
     private:
         juce::Array<Region *> regions_;
+        
+        // Selected by updateRegionIndex() or a subclass, e.g. per preset
+        juce::Atomic<RegionTable *> regionTable_;
+        // Built by updateRegionIndex(). Kept until destruction, as voices may still use a replaced one.
+        juce::OwnedArray<RegionTable> regionTables_;
+        
         juce::StringArray errors_;
         juce::StringArray warnings_;
         juce::HashMap<juce::String, juce::String> unsupportedOpcodes_;
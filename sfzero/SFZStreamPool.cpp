@@ -0,0 +1,206 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#include "SFZStreamPool.h"
+
+using namespace juce;
+using namespace sfzero;
+
+
+/*********************************************************************************
+ *    SampleStream
+ *********************************************************************************/
+
+namespace
+{
+    // Frames read from disk at once per stream, so all streams are served in turn
+    const int readBlockSize = 4096;
+}
+
+SampleStream::SampleStream () :
+    state_(idle),
+    start_(0),
+    loopStart_(0),
+    loopEnd_(0),
+    looping_(false),
+    filled_(0),
+    consumed_(0),
+    loopReleaseAt_(-1),
+    loopReleased_(0),
+    fillPosition_(0),
+    filePosition_(0)
+{
+}
+
+int64 SampleStream::readLimit () const
+{
+    // Until the pool's thread has stopped looping, frames after the loop end may be
+    // from the loop start
+    const int64 releaseAt = loopReleaseAt_.get();
+    if (releaseAt >= 0 && loopReleased_.get() == 0)
+        return jmin(filled_.get(), releaseAt);
+    return filled_.get();
+}
+
+bool SampleStream::read (float *left, float *right, int64 position, int numFrames)
+{
+    const int available = static_cast<int>(jlimit<int64>(0, numFrames, readLimit() - position));
+
+    for (int done = 0; done < available; )
+    {
+        const int offset = static_cast<int>((position + done) & (ringSize - 1));
+        const int length = jmin(available - done, ringSize - offset);
+        FloatVectorOperations::copy(left + done, ring_.getReadPointer(0, offset), length);
+        if (right != nullptr)
+            FloatVectorOperations::copy(right + done, ring_.getReadPointer(1, offset), length);
+        done += length;
+    }
+    if (available == numFrames)
+        return true;
+
+    FloatVectorOperations::clear(left + available, numFrames - available);
+    if (right != nullptr)
+        FloatVectorOperations::clear(right + available, numFrames - available);
+    return false;
+}
+
+bool SampleStream::fill ()
+{
+    // Stop looping when the voice asks to, and read again what was read from the
+    // loop start after the loop end
+    const int64 releaseAt = loopReleaseAt_.get();
+    if (releaseAt >= 0 && loopReleased_.get() == 0)
+    {
+        if (looping_ && fillPosition_ >= releaseAt)
+        {
+            fillPosition_ = releaseAt;
+            filePosition_ = loopEnd_;
+            filled_.set(fillPosition_);
+        }
+        looping_ = false;
+        loopReleased_.set(1);
+    }
+
+    if (reader_ == nullptr)
+        return false;
+
+    int numFrames = static_cast<int>(jmin<int64>(consumed_.get() + ringSize - fillPosition_, readBlockSize));
+    if (numFrames <= 0)
+        return false;
+
+    if (looping_)
+        numFrames = static_cast<int>(jmin<int64>(numFrames, loopEnd_ - filePosition_));
+    const int offset = static_cast<int>(fillPosition_ & (ringSize - 1));
+    numFrames = jmin(numFrames, ringSize - offset);
+
+    // Reads past the end of the file are filled with zeros
+    reader_->read(&ring_, offset, numFrames, filePosition_, true, true);
+    fillPosition_ += numFrames;
+    filePosition_ += numFrames;
+    if (looping_ && filePosition_ >= loopEnd_)
+        filePosition_ = loopStart_;
+
+    filled_.set(fillPosition_);
+    return true;
+}
+
+/*********************************************************************************
+ *    StreamPool
+ *********************************************************************************/
+
+juce_ImplementSingleton (sfzero::StreamPool)
+
+StreamPool::StreamPool () :
+    Thread ("SFZero disk streaming")
+{
+    formatManager_.registerBasicFormats();
+    for (int i = 0; i < maxStreams; ++i)
+        streams_.add(new SampleStream());
+    startThread(8);
+}
+
+StreamPool::~StreamPool ()
+{
+    stopThread(1000);
+    clearSingletonInstance();
+}
+
+SampleStream* StreamPool::start (const File &file, int64 start,
+                                 int64 loopStart, int64 loopEnd, bool looping)
+{
+    for (SampleStream *stream : streams_)
+    {
+        if (stream->state_.compareAndSetBool(SampleStream::claimed, SampleStream::idle))
+        {
+            // The pool's thread leaves a stream's file empty when done with it, so
+            // nothing is freed here
+            stream->file_ = file;
+            stream->start_ = start;
+            stream->loopStart_ = loopStart;
+            stream->loopEnd_ = loopEnd;
+            stream->looping_ = looping && (loopStart < loopEnd) && (start < loopEnd);
+            stream->filled_.set(0);
+            stream->consumed_.set(0);
+            stream->loopReleaseAt_.set(-1);
+            stream->loopReleased_.set(0);
+            stream->state_.set(SampleStream::starting);
+            return stream;
+        }
+    }
+    return nullptr;
+}
+
+void StreamPool::stop (SampleStream *stream)
+{
+    if (stream != nullptr)
+        stream->state_.set(SampleStream::stopping);
+}
+
+void StreamPool::run ()
+{
+    while (!threadShouldExit())
+    {
+        bool busy = false;
+        for (SampleStream *stream : streams_)
+        {
+            switch (stream->state_.get())
+            {
+                case SampleStream::starting:
+                    stream->reader_.reset(formatManager_.createReaderFor(stream->file_));
+                    if (stream->ring_.getNumSamples() == 0)
+                        stream->ring_.setSize(2, SampleStream::ringSize);
+                    stream->fillPosition_ = 0;
+                    stream->filePosition_ = stream->start_;
+                    // Unless the voice stopped it meanwhile
+                    stream->state_.compareAndSetBool(SampleStream::streaming, SampleStream::starting);
+                    busy = true;
+                    break;
+
+                case SampleStream::streaming:
+                    busy = stream->fill() || busy;
+                    break;
+
+                case SampleStream::stopping:
+                    stream->reader_.reset();
+                    stream->file_ = File();
+                    stream->state_.set(SampleStream::idle);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        if (!busy)
+            wait(pollInterval);
+    }
+}
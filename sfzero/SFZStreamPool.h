@@ -0,0 +1,117 @@
+/***********************************************************************
+ *  SFZeroMT Multi-Timbral Juce Module
+ *
+ *  Original SFZero Copyright (C) 2012 Steve Folta
+ *      https://github.com/stevefolta/SFZero
+ *  Converted to Juce module Copyright (C) 2016 Leo Olivers
+ *      https://github.com/altalogix/SFZero
+ *  Extended for multi-timbral operation Copyright (C) 2017 Cognitone
+ *      https://github.com/cognitone/SFZeroMT
+ *
+ *  Licensed under MIT License - Please read regard LICENSE document
+ ***********************************************************************/
+
+#ifndef SFZSTREAMPOOL_H_INCLUDED
+#define SFZSTREAMPOOL_H_INCLUDED
+
+#include "SFZCommon.h"
+
+namespace sfzero
+{
+    /** The frames of a sample after its preloaded head, read from disk into a ring buffer
+        by the StreamPool's thread while a voice plays them.
+
+        Frames are counted from the position the stream was started at, in playback order:
+        while looping, the stream continues at the loop start after the loop end, so the
+        voice reads it like a sample with the loop unrolled. A voice reads and releases
+        frames on the audio thread, the pool's thread fills them in; neither waits for
+        the other.
+     */
+
+    class SampleStream
+    {
+    public:
+
+        enum { ringSize = 1 << 15 }; // frames, about 0.7 s at 44.1 kHz
+
+        /** Copies numFrames from position on into left (and right, if not nullptr). Frames
+            not read from disk yet are set to zero. Returns false if that happened (underrun).
+            Realtime-safe. */
+        bool read (float *left, float *right, juce::int64 position, int numFrames);
+
+        /** Frames before position are not needed anymore, so their space can be refilled */
+        void setConsumed (juce::int64 position) { consumed_.set(juce::jmax(consumed_.get(), position)); }
+
+        /** Stops looping at position, which must be the stream position of the next loop end */
+        void releaseLoop (juce::int64 position) { loopReleaseAt_.set(position); }
+
+    private:
+
+        friend class StreamPool;
+
+        SampleStream();
+
+        enum State { idle = 0, claimed, starting, streaming, stopping };
+
+        bool fill();
+        juce::int64 readLimit() const;
+
+        juce::Atomic<int> state_;
+
+        // Set by the voice before starting
+        juce::File file_;
+        juce::int64 start_, loopStart_, loopEnd_;
+        bool looping_;
+
+        // Progress, published by the pool's thread and the voice respectively
+        juce::Atomic<juce::int64> filled_, consumed_;
+        juce::Atomic<juce::int64> loopReleaseAt_;
+        juce::Atomic<int> loopReleased_;
+
+        // Used by the pool's thread only
+        std::unique_ptr<juce::AudioFormatReader> reader_;
+        juce::AudioSampleBuffer ring_;
+        juce::int64 fillPosition_, filePosition_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleStream)
+    };
+
+    /** A global singleton with a fixed number of SampleStreams and the thread that
+        reads them from disk.
+
+        Voices start and stop streams on the audio thread without locking or allocating.
+        The thread opens the files, and allocates a stream's ring buffer when the stream
+        is first used.
+     */
+
+    class StreamPool : private juce::Thread
+    {
+    public:
+        StreamPool();
+        ~StreamPool();
+
+        juce_DeclareSingleton (StreamPool, false);
+
+        enum { maxStreams = 256 };
+
+        /** Starts streaming the file from start on, with the loop if looping. Returns the
+            stream to read from, or nullptr if all streams are in use. Realtime-safe. */
+        SampleStream* start (const juce::File &file, juce::int64 start,
+                             juce::int64 loopStart, juce::int64 loopEnd, bool looping);
+
+        /** Returns a stream to the pool. Realtime-safe. */
+        void stop (SampleStream *stream);
+
+    private:
+        enum { pollInterval = 2 }; // ms
+
+        void run() override;
+
+        juce::AudioFormatManager formatManager_;
+        juce::OwnedArray<SampleStream> streams_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StreamPool)
+    };
+}
+
+#endif // SFZSTREAMPOOL_H_INCLUDED
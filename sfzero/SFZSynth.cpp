@@ -12,6 +12,7 @@
  ***********************************************************************/
 
 #include "SFZSynth.h"
+#include "SFZReleasePool.h"
 #include "SFZSound.h"
 #include "SFZVoice.h"
 
@@ -19,265 +20,190 @@ using namespace juce;
 using namespace sfzero;
 
 
-Synth::Synth (int channel) :
+/*********************************************************************************
+ *    SynthBase
+ *********************************************************************************/
+
+SynthBase::SynthBase () :
     Synthesiser(),
-    channel_(channel),
-    selectionCache_(0,0, ""),
-    selectedBank_MSB_(0),
-    sendLevelCC_(0),
-    masterVolumeCC_(90),
-    masterPanCC_(64)
+    interpolation_(interpolateLinear)
 {
-    // This translates MIDI CC to linear multiplicators for rendering
-    setParameter(kParam_Volume, masterVolumeCC_.get()/127.0);
-    setParameter(kParam_Pan, masterPanCC_.get()/127.0);
-    setParameter(kParam_Send, sendLevelCC_.get()/127.0);
-    selectionChanged.set(0);
+    numActiveVoices_.set(0);
+    changeRequested_.set(0);
+    startTimer(changeMessageInterval);
 }
 
-Synth::~Synth ()
+SynthBase::~SynthBase ()
 {
-    sounds.clear();
+    stopTimer();
 }
 
-
-void Synth::swapSound (const SynthesiserSound::Ptr &newSound)
+void SynthBase::timerCallback()
 {
-    ScopedLock locker (lock);
-    
-    allNotesOff(0, false);
-    sounds.clear();
-    sounds.add(newSound);
+    if (changeRequested_.compareAndSetBool(0, 1))
+    {
+        sendChangeMessage();
+    }
 }
 
-Sound* Synth::getSound ()
+Voice* SynthBase::addVoice (Voice *newVoice)
 {
-    SynthesiserSound::Ptr s = Synthesiser::getSound(0);
-    return dynamic_cast<Sound*>(s.get());
+    ScopedLock locker (lock);
+
+    Synthesiser::addVoice(newVoice);
+    allVoices_.push_back(newVoice);
+    freeVoices_.push_back(newVoice);
+    activeVoices_.reserve(allVoices_.size());
+    freeVoices_.reserve(allVoices_.size());
+    return newVoice;
 }
 
-void Synth::setProgramSelection (const ProgramSelection& selection)
+void SynthBase::removeVoice (int index)
 {
     ScopedLock locker (lock);
-    
-    Sound* sound = getSound();
-    if (sound)
+
+    if (isPositiveAndBelow(index, static_cast<int>(allVoices_.size())))
     {
-        if (!selection.equals (sound->getProgramSelection()))
+        Voice *voice = allVoices_[index];
+        if (voice->activeSlot >= 0)
         {
-            allNotesOff(0, false);
-            sound->setProgramSelection(selection);
+            activeVoices_[voice->activeSlot] = activeVoices_.back();
+            activeVoices_[voice->activeSlot]->activeSlot = voice->activeSlot;
+            activeVoices_.pop_back();
+            voice->activeSlot = -1;
         }
-        selectionCache_ = sound->getProgramSelection();
-        
-    } else {
-        selectionCache_ = selection;
-        selectionCache_.name = String();
+        freeVoices_.erase(std::remove(freeVoices_.begin(), freeVoices_.end(), voice), freeVoices_.end());
+        allVoices_.erase(allVoices_.begin() + index);
     }
-    jassert (selectionCache_.index() == selection.index());
-    selectionChanged.set(1);
-    sendChangeMessage();
-    
-    DBG ("  Channel = " << channel_
-         << " Bank = " << selectionCache_.bank
-         << "  Program = " << selectionCache_.program
-         << " " << selectionCache_.name);
+    Synthesiser::removeVoice(index);
 }
 
-ProgramSelection& Synth::getProgramSelection ()
+void SynthBase::clearVoices ()
 {
     ScopedLock locker (lock);
-    
-    Sound* sound = getSound();
-    if (sound)
-        return sound->getProgramSelection();
-    else
-        return selectionCache_;
-}
 
-int Synth::getProgramCount (int bank)
-{
-    ScopedLock locker (lock);
-    
-    Sound* sound = getSound();
-    if (sound)
-        return sound->getProgramCount(bank);
-    else
-        return 1;
+    allVoices_.clear();
+    activeVoices_.clear();
+    freeVoices_.clear();
+    numActiveVoices_.set(0);
+    Synthesiser::clearVoices();
 }
 
-String Synth::getProgramName (const ProgramSelection& selection)
+Voice* SynthBase::acquireVoice (SynthesiserSound *sound, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable)
 {
-    ScopedLock locker (lock);
-    
-    Sound* sound = getSound();
-    if (sound)
-        return sound->getProgramName(selection);
-    else
-        return String();
-}
+    // Voices added through juce::Synthesiser::addVoice() would never be used
+    jassert (allVoices_.size() == static_cast<size_t>(voices.size()));
 
-ProgramList* Synth::getProgramList()
-{
-    ScopedLock locker (lock);
-    
-    Sound* sound = getSound();
-    if (sound)
-        return sound->getProgramList();
-    else
-        return new ProgramList();
+    Voice *voice = nullptr;
+    if (freeVoices_.empty())
+    {
+        releaseFinishedVoices();
+    }
+    if (!freeVoices_.empty())
+    {
+        voice = freeVoices_.back();
+        freeVoices_.pop_back();
+        voice->activeSlot = static_cast<int>(activeVoices_.size());
+        activeVoices_.push_back(voice);
+        numActiveVoices_.set(static_cast<int>(activeVoices_.size()));
+    }
+    else if (stealIfNoneAvailable)
+    {
+        // All voices are sounding, so let juce::Synthesiser pick one. It stays in the active list.
+        voice = static_cast<Voice *>(Synthesiser::findFreeVoice(sound, midiChannel, midiNoteNumber, true));
+    }
+    if (voice)
+    {
+        voice->midiChannel = midiChannel;
+    }
+    return voice;
 }
 
-float Synth::getParameter (int index)
+void SynthBase::releaseFinishedVoices ()
 {
-    // value range is 0...1 (fader position)
-    switch (index)
+    // Backwards, so the voice swapped into a released slot has been checked already
+    for (int i = static_cast<int>(activeVoices_.size()); --i >= 0;)
     {
-        case kParam_Volume:
-            return masterVolumeCC_.get()/127.0;
-            break;
-            
-        case kParam_Pan:
-            return masterPanCC_.get()/127.0;
-            break;
-            
-        case kParam_Send:
-            return sendLevelCC_.get()/127.0;
-            break;
-            
-        default:
-            break;
+        Voice *voice = activeVoices_[i];
+        if (voice->getCurrentlyPlayingNote() < 0)
+        {
+            activeVoices_[i] = activeVoices_.back();
+            activeVoices_[i]->activeSlot = i;
+            activeVoices_.pop_back();
+            voice->activeSlot = -1;
+            freeVoices_.push_back(voice);
+        }
     }
-    return 0;
+    numActiveVoices_.set(static_cast<int>(activeVoices_.size()));
 }
 
-void  Synth::setParameter (int index, float newValue)
+void SynthBase::selectProgram (Channel &channel, const ProgramSelection& selection)
 {
-    // value range is 0...1 (fader position)
-    float value = jlimit (0.0f, 1.0f, newValue);
-    
-    switch (index)
-    {
-        case kParam_Volume:
-			masterVolumeCC_.set(juce::roundToInt(value * 127));
-            masterVolume_.set(convertFaderToGain6dB (value));
-            //DBG("fader=" << value << " gain=" << masterVolume_.get());
-            break;
-            
-        case kParam_Pan:
-            float l, r;
-            masterPanCC_.set(juce::roundToInt(value * 127));
-            convertFaderToPan (value, l, r);
-            masterPanL_.set(l);
-            masterPanR_.set(r);
-            break;
-            
-        case kParam_Send:
-            sendLevelCC_.set(juce::roundToInt(value * 127));
-            sendLevel_.set(convertFaderToGain0dB (value));
-            break;
-            
-        default:
-            break;
-    }
-    sendChangeMessage();
+    // Notes keep playing: their regions belong to the sound, which outlives them
+    channel.setProgramSelection(selection);
+    requestChangeMessage();
 }
 
-bool Synth::usesEffectsUnit()
+void SynthBase::setInterpolationQuality (InterpolationQuality quality)
 {
-    return sendLevelCC_.get() > 0;
+    prepareInterpolation (quality);
+
+    ScopedLock locker (lock);
+
+    interpolation_.set(quality);
+    for (Voice *voice : allVoices_)
+    {
+        voice->setInterpolationQuality(quality);
+    }
 }
 
-void Synth::handleMidiEvent (const MidiMessage& m)
+InterpolationQuality SynthBase::getInterpolationQuality()
 {
-    // Ignore all messages not on my channel
-    if (m.getChannel() == channel_)
-        Synthesiser::handleMidiEvent(m);
+    return static_cast<InterpolationQuality>(interpolation_.get());
 }
 
-void Synth::handleController (int midiChannel, int controllerNumber, int controllerValue)
+void SynthBase::handleController (int midiChannel, int controllerNumber, int controllerValue)
 {
-    switch (controllerNumber)
+    Channel *channel = getChannel(midiChannel);
+    if (channel && channel->handleController(controllerNumber, controllerValue))
     {
-        case 0:
-            // Bank selection requires MSB, LSB in that order!
-            selectedBank_MSB_ = controllerValue;
-            return;
-            break;
-            
-        case 32:
-            // Final LSB will determine and set the current bank number
-            selectionCache_.bank = 128 * selectedBank_MSB_ + controllerValue;
-            selectedBank_MSB_ = 0;
-            return;
-            break;
-            
-        case 7:
-            // Volume
-            setParameter(kParam_Volume, controllerValue / 127.0);
-            return;
-            break;
-            
-        case 10:
-            // Pan
-            setParameter(kParam_Pan, controllerValue / 127.0);
-            return;
-            break;
-            
-        case 91:
-            // Reverb Send
-            setParameter(kParam_Send, controllerValue / 127.0);
-            return;
-            break;
-            
-        case 121:
-            // Reset All Controllers
-            setParameter(kParam_Send, 0);
-            setParameter(kParam_Pan, 0.5f);
-            setParameter(kParam_Volume, 90.0f / 127.0f);
-            // fall through to superclass, so voices get to reset ModWheel, etc
-            break;
-            
-        default:
-            break;
+        return;
     }
     // Superclass handles pedals, passes CC on to each voice
     Synthesiser::handleController (midiChannel, controllerNumber, controllerValue);
 }
 
-void Synth::handleProgramChange (int midiChannel, int programNumber)
+void SynthBase::handleProgramChange (int midiChannel, int programNumber)
 {
-    selectionCache_.program = programNumber;
-    setProgramSelection(selectionCache_);
-}
-
-bool Synth::hasProgramSelectionChanged (bool reset)
-{
-    // resets value after queried
-    if (selectionChanged.get())
+    // Called from renderNextBlock(), which holds the lock already
+    Channel *channel = getChannel(midiChannel);
+    if (channel)
     {
-        if (reset)
-            selectionChanged.set(0);
-        return true;
+        selectProgram(*channel, channel->programChange(programNumber));
     }
-    return false;
 }
 
-void Synth::noteOn (int midiChannel,
-                    int midiNoteNumber,
-                    float velocity)
+void SynthBase::noteOn (int midiChannel,
+                        int midiNoteNumber,
+                        float velocity)
 {
     int i;
-    
+
     const ScopedLock locker(lock);
-    
+
+    Channel *channel = getChannel(midiChannel);
+    if (channel == nullptr)
+    {
+        return;
+    }
+
     int midiVelocity = static_cast<int>(velocity * 127);
-    
+
     // First, stop any currently-playing sounds in the group.
     //*** Currently, this only pays attention to the first matching region.
     int group = 0;
-    Sound* sound = getSound();
-    
+    Sound* sound = channel->getSound();
+
     if (sound)
     {
         Region *region = sound->getRegionFor(midiNoteNumber, midiVelocity);
@@ -288,30 +214,20 @@ void Synth::noteOn (int midiChannel,
     }
     if (group != 0)
     {
-        for (i = voices.size(); --i >= 0;)
+        for (Voice *voice : activeVoices_)
         {
-            Voice *voice = dynamic_cast<Voice *>(voices.getUnchecked(i));
-            if (voice == nullptr)
-            {
-                continue;
-            }
-            if (voice->getOffBy() == group)
+            if (voice->getOffBy() == group && voice->isPlayingChannel(midiChannel))
             {
                 voice->stopNoteForGroup();
             }
         }
     }
-    
+
     // Are any notes playing?  (Needed for first/legato trigger handling.)
     // Also stop any voices still playing this note.
     bool anyNotesPlaying = false;
-    for (i = voices.size(); --i >= 0;)
+    for (Voice *voice : activeVoices_)
     {
-        Voice *voice = dynamic_cast<Voice *>(voices.getUnchecked(i));
-        if (voice == nullptr)
-        {
-            continue;
-        }
         if (voice->isPlayingChannel(midiChannel))
         {
             if (voice->isPlayingNoteDown())
@@ -330,101 +246,93 @@ void Synth::noteOn (int midiChannel,
             }
         }
     }
-    
+
     // Play *all* matching regions.
     Region::Trigger trigger = (anyNotesPlaying ? Region::legato : Region::first);
     if (sound)
     {
-        int numRegions = sound->getNumRegions();
-        for (i = 0; i < numRegions; ++i)
+        int numCandidates;
+        Region * const *candidates = sound->getRegionCandidates(midiNoteNumber, midiVelocity, numCandidates);
+        for (i = 0; i < numCandidates; ++i)
         {
-            Region *region = sound->regionAt(i);
+            Region *region = candidates[i];
             if (region->matches(midiNoteNumber, midiVelocity, trigger))
             {
-                Voice *voice =
-                dynamic_cast<Voice *>(findFreeVoice(sound, midiNoteNumber, midiChannel, isNoteStealingEnabled()));
+                Voice *voice = acquireVoice(sound, midiChannel, midiNoteNumber, isNoteStealingEnabled());
                 if (voice)
                 {
                     voice->setRegion(sound, region);
+                    voice->setInterpolationQuality(getInterpolationQuality());
                     startVoice(voice, sound, midiChannel, midiNoteNumber, velocity);
                 }
             }
         }
     }
-    
-    noteVelocities_[midiNoteNumber] = midiVelocity;
+
+    channel->setNoteVelocity(midiNoteNumber, midiVelocity);
 }
 
-void Synth::noteOff (int midiChannel,
-                     int midiNoteNumber,
-                     float velocity,
-                     bool allowTailOff)
+void SynthBase::noteOff (int midiChannel,
+                         int midiNoteNumber,
+                         float velocity,
+                         bool allowTailOff)
 {
     const ScopedLock locker(lock);
-    
+
     Synthesiser::noteOff (midiChannel, midiNoteNumber, velocity, allowTailOff);
-    
+
     // Start release region.
-    Sound* sound = getSound();
+    Channel *channel = getChannel(midiChannel);
+    Sound* sound = channel ? channel->getSound() : nullptr;
     if (sound)
     {
-        Region *region = sound->getRegionFor(midiNoteNumber, noteVelocities_[midiNoteNumber], Region::release);
+        const int noteVelocity = channel->getNoteVelocity(midiNoteNumber);
+        Region *region = sound->getRegionFor(midiNoteNumber, noteVelocity, Region::release);
         if (region)
         {
-            Voice *voice = dynamic_cast<Voice *>(findFreeVoice(sound, midiNoteNumber, midiChannel, false));
+            Voice *voice = acquireVoice(sound, midiChannel, midiNoteNumber, false);
             if (voice)
             {
                 // Synthesiser is too locked-down (ivars are private rt protected), so
                 // we have to use a "setRegion()" mechanism.
                 voice->setRegion(sound, region);
-                startVoice(voice, sound, midiChannel, midiNoteNumber, noteVelocities_[midiNoteNumber] / 127.0f);
+                voice->setInterpolationQuality(getInterpolationQuality());
+                startVoice(voice, sound, midiChannel, midiNoteNumber, noteVelocity / 127.0f);
             }
         }
     }
 }
 
-void Synth::renderVoices (AudioSampleBuffer &outputAudio, int startSample, int numSamples)
+int SynthBase::numVoicesUsed()
 {
-    for (int i = voices.size(); --i >= 0;)
-        voices.getUnchecked (i)->renderNextBlock (outputAudio, startSample, numSamples);
-    
-    // Master Volume & Pan
-    outputAudio.applyGain (0, startSample, numSamples, masterVolume_.get() * masterPanL_.get());
-    outputAudio.applyGain (1, startSample, numSamples, masterVolume_.get() * masterPanR_.get());
-    
-    // Sidechain: Reverb send outputs
-    jassert(outputAudio.getNumChannels() == 4);
-    const float send = sendLevel_.get();
-    outputAudio.copyFromWithRamp(2, 0, outputAudio.getReadPointer(0), numSamples, send, send);
-    outputAudio.copyFromWithRamp(3, 0, outputAudio.getReadPointer(1), numSamples, send, send);
+    // As of the last rendered block or note-on
+    return numActiveVoices_.get();
 }
 
-int Synth::numVoicesUsed()
+int SynthBase::numStreamUnderruns()
 {
-    int numUsed = 0;
-    
-    for (int i = voices.size(); --i >= 0;)
+    ScopedLock locker (lock);
+    int underruns = 0;
+    for (Voice *voice : allVoices_)
     {
-        if (voices.getUnchecked(i)->getCurrentlyPlayingNote() >= 0)
-        {
-            numUsed += 1;
-        }
+        underruns += voice->getNumUnderruns();
     }
-    return numUsed;
+    return underruns;
 }
 
-String Synth::voiceInfoString()
+String SynthBase::voiceInfoString()
 {
     enum
     {
         maxShownVoices = 20,
     };
-    
+
+    const ScopedLock locker(lock);
+
     StringArray lines;
     int numUsed = 0, numShown = 0;
-    for (int i = voices.size(); --i >= 0;)
+    for (Voice *voice : activeVoices_)
     {
-        Voice *voice = dynamic_cast<Voice *>(voices.getUnchecked(i));
         if (voice->getCurrentlyPlayingNote() < 0)
         {
             continue;
@@ -441,11 +349,213 @@ String Synth::voiceInfoString()
 }
 
 
+/*********************************************************************************
+ *    Channel
+ *********************************************************************************/
 
-std::unique_ptr<XmlElement> Synth::getStateXML ()
+Channel::Channel (int midiChannel, SynthBase &owner) :
+    midiChannel_(midiChannel),
+    owner_(owner),
+    soundPtr_(),
+    sound_(nullptr),
+    selectionCache_(0,0, ""),
+    selectedBank_MSB_(0),
+    sendLevelCC_(0),
+    masterVolumeCC_(90),
+    masterPanCC_(64)
+{
+    for (int &velocity : noteVelocities_)
+        velocity = 0;
+    // This translates MIDI CC to linear multiplicators for rendering
+    setParameter(SynthBase::kParam_Volume, masterVolumeCC_.get()/127.0);
+    setParameter(SynthBase::kParam_Pan, masterPanCC_.get()/127.0);
+    setParameter(SynthBase::kParam_Send, sendLevelCC_.get()/127.0);
+    selectionChanged.set(0);
+}
+
+void Channel::setSound (const SynthesiserSound::Ptr &newSound)
+{
+    // Typecast once here, rather than per note on the audio thread
+    soundPtr_ = newSound;
+    sound_ = dynamic_cast<Sound*>(newSound.get());
+}
+
+void Channel::setProgramSelection (const ProgramSelection& selection)
+{
+    if (sound_)
+    {
+        sound_->setProgramSelection(selection);
+    }
+    // Copy the numbers only, strings are not realtime-safe
+    selectionCache_.bank = selection.bank;
+    selectionCache_.program = selection.program;
+    selectionChanged.set(1);
+}
+
+ProgramSelection& Channel::programChange (int programNumber)
+{
+    selectionCache_.program = programNumber;
+    return selectionCache_;
+}
+
+ProgramSelection& Channel::getProgramSelection ()
+{
+    if (sound_)
+        return sound_->getProgramSelection();
+    else
+        return selectionCache_;
+}
+
+int Channel::getProgramCount (int bank)
+{
+    if (sound_)
+        return sound_->getProgramCount(bank);
+    else
+        return 1;
+}
+
+String Channel::getProgramName (const ProgramSelection& selection)
+{
+    if (sound_)
+        return sound_->getProgramName(selection);
+    else
+        return String();
+}
+
+ProgramList* Channel::getProgramList()
+{
+    if (sound_)
+        return sound_->getProgramList();
+    else
+        return new ProgramList();
+}
+
+bool Channel::hasProgramSelectionChanged (bool reset)
+{
+    // resets value after queried
+    if (selectionChanged.get())
+    {
+        if (reset)
+            selectionChanged.set(0);
+        return true;
+    }
+    return false;
+}
+
+float Channel::getParameter (int index)
+{
+    // value range is 0...1 (fader position)
+    switch (index)
+    {
+        case SynthBase::kParam_Volume:
+            return masterVolumeCC_.get()/127.0;
+            break;
+
+        case SynthBase::kParam_Pan:
+            return masterPanCC_.get()/127.0;
+            break;
+
+        case SynthBase::kParam_Send:
+            return sendLevelCC_.get()/127.0;
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+void Channel::setParameter (int index, float newValue)
+{
+    // value range is 0...1 (fader position)
+    float value = jlimit (0.0f, 1.0f, newValue);
+
+    switch (index)
+    {
+        case SynthBase::kParam_Volume:
+			masterVolumeCC_.set(juce::roundToInt(value * 127));
+            masterVolume_.set(convertFaderToGain6dB (value));
+            //DBG("fader=" << value << " gain=" << masterVolume_.get());
+            break;
+
+        case SynthBase::kParam_Pan:
+            float l, r;
+            masterPanCC_.set(juce::roundToInt(value * 127));
+            convertFaderToPan (value, l, r);
+            masterPanL_.set(l);
+            masterPanR_.set(r);
+            break;
+
+        case SynthBase::kParam_Send:
+            sendLevelCC_.set(juce::roundToInt(value * 127));
+            sendLevel_.set(convertFaderToGain0dB (value));
+            break;
+
+        default:
+            break;
+    }
+    owner_.requestChangeMessage();
+}
+
+bool Channel::usesEffectsUnit()
+{
+    return sendLevelCC_.get() > 0;
+}
+
+bool Channel::handleController (int controllerNumber, int controllerValue)
+{
+    switch (controllerNumber)
+    {
+        case 0:
+            // Bank selection requires MSB, LSB in that order!
+            selectedBank_MSB_ = controllerValue;
+            return true;
+            break;
+
+        case 32:
+            // Final LSB will determine and set the current bank number
+            selectionCache_.bank = 128 * selectedBank_MSB_ + controllerValue;
+            selectedBank_MSB_ = 0;
+            return true;
+            break;
+
+        case 7:
+            // Volume
+            setParameter(SynthBase::kParam_Volume, controllerValue / 127.0);
+            return true;
+            break;
+
+        case 10:
+            // Pan
+            setParameter(SynthBase::kParam_Pan, controllerValue / 127.0);
+            return true;
+            break;
+
+        case 91:
+            // Reverb Send
+            setParameter(SynthBase::kParam_Send, controllerValue / 127.0);
+            return true;
+            break;
+
+        case 121:
+            // Reset All Controllers
+            setParameter(SynthBase::kParam_Send, 0);
+            setParameter(SynthBase::kParam_Pan, 0.5f);
+            setParameter(SynthBase::kParam_Volume, 90.0f / 127.0f);
+            // voices get to reset ModWheel, etc
+            return false;
+            break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
+std::unique_ptr<XmlElement> Channel::getStateXML ()
 {
     auto xml = std::make_unique<XmlElement> ("SYNTH");
-    xml->setAttribute ("slot",  channel_-1);
+    xml->setAttribute ("slot",  midiChannel_-1);
     // File and patch selection is handled by the parent (owner)
     // CC and raw values are saved to be robust against future changes in MIDI or UI handling
     xml->setAttribute("volume-cc", masterVolumeCC_.get());
@@ -458,15 +568,15 @@ std::unique_ptr<XmlElement> Synth::getStateXML ()
     return xml;
 }
 
-bool Synth::setStateXML (const XmlElement* xml)
+bool Channel::setStateXML (const XmlElement* xml)
 {
     if ((xml == nullptr) || !xml->hasTagName ("SYNTH"))
         return false;
-    
+
     // Channel is a fixed assignment that must match!
-    if ((channel_-1) != xml->getIntAttribute ("slot", 0))
+    if ((midiChannel_-1) != xml->getIntAttribute ("slot", 0))
         return false;
-    
+
     masterVolumeCC_.set(xml->getIntAttribute("volume-cc"));
     masterVolume_.set(xml->getDoubleAttribute("volume"));
     masterPanCC_.set(xml->getIntAttribute("pan-cc"));
@@ -474,7 +584,146 @@ bool Synth::setStateXML (const XmlElement* xml)
     masterPanR_.set(xml->getDoubleAttribute("pan-right"));
     sendLevelCC_.set(xml->getIntAttribute("send-cc"));
     sendLevel_.set(xml->getDoubleAttribute("send"));
-    
     return true;
 }
 
+
+/*********************************************************************************
+ *    Synth
+ *********************************************************************************/
+
+Synth::Synth (int channel) :
+    SynthBase(),
+    channel_(channel, *this)
+{
+}
+
+Synth::~Synth ()
+{
+    sounds.clear();
+}
+
+Channel* Synth::getChannel (int midiChannel)
+{
+    return (midiChannel == channel_.getMidiChannel()) ? &channel_ : nullptr;
+}
+
+void Synth::swapSound (const SynthesiserSound::Ptr &newSound)
+{
+    // The previous sound is taken under the lock, so the audio thread is done with
+    // it, and deleted in the background rather than here under the lock
+    SynthesiserSound::Ptr oldSound;
+    {
+        ScopedLock locker (lock);
+
+        oldSound = channel_.getSound();
+        allNotesOff(0, false);
+        sounds.clear();
+        sounds.add(newSound);
+        channel_.setSound(newSound);
+    }
+    ReleasePool::getInstance()->add(oldSound.get());
+}
+
+Sound* Synth::getSound ()
+{
+    return channel_.getSound();
+}
+
+void Synth::setProgramSelection (const ProgramSelection& selection)
+{
+    ScopedLock locker (lock);
+
+    selectProgram(channel_, selection);
+}
+
+ProgramSelection& Synth::getProgramSelection ()
+{
+    ScopedLock locker (lock);
+
+    return channel_.getProgramSelection();
+}
+
+int Synth::getProgramCount (int bank)
+{
+    ScopedLock locker (lock);
+
+    return channel_.getProgramCount(bank);
+}
+
+String Synth::getProgramName (const ProgramSelection& selection)
+{
+    ScopedLock locker (lock);
+
+    return channel_.getProgramName(selection);
+}
+
+ProgramList* Synth::getProgramList()
+{
+    ScopedLock locker (lock);
+
+    return channel_.getProgramList();
+}
+
+float Synth::getParameter (int index)
+{
+    return channel_.getParameter(index);
+}
+
+void  Synth::setParameter (int index, float newValue)
+{
+    channel_.setParameter(index, newValue);
+}
+
+bool Synth::usesEffectsUnit()
+{
+    return channel_.usesEffectsUnit();
+}
+
+bool Synth::hasProgramSelectionChanged (bool reset)
+{
+    return channel_.hasProgramSelectionChanged(reset);
+}
+
+void Synth::handleMidiEvent (const MidiMessage& m)
+{
+    // Ignore all messages not on my channel
+    if (m.getChannel() == channel_.getMidiChannel())
+        Synthesiser::handleMidiEvent(m);
+}
+
+void Synth::renderVoices (AudioSampleBuffer &outputAudio, int startSample, int numSamples)
+{
+    for (Voice *voice : activeVoices_)
+        voice->renderNextBlock (outputAudio, startSample, numSamples);
+    releaseFinishedVoices();
+
+    // Master Volume & Pan
+    outputAudio.applyGain (0, startSample, numSamples, channel_.getGainLeft());
+    outputAudio.applyGain (1, startSample, numSamples, channel_.getGainRight());
+
+    // Sidechain: Reverb send outputs
+    jassert(outputAudio.getNumChannels() == 4);
+    const float send = channel_.getSendLevel();
+    outputAudio.copyFromWithRamp(2, 0, outputAudio.getReadPointer(0), numSamples, send, send);
+    outputAudio.copyFromWithRamp(3, 0, outputAudio.getReadPointer(1), numSamples, send, send);
+}
+
+std::unique_ptr<XmlElement> Synth::getStateXML ()
+{
+    auto xml = channel_.getStateXML();
+    xml->setAttribute("interpolation", interpolation_.get());
+    return xml;
+}
+
+bool Synth::setStateXML (const XmlElement* xml)
+{
+    if (!channel_.setStateXML(xml))
+        return false;
+
+    const int interpolation = xml->getIntAttribute("interpolation", interpolateLinear);
+    if (interpolation >= 0 && interpolation < numInterpolationQualities)
+        setInterpolationQuality(static_cast<InterpolationQuality>(interpolation));
+
+    return true;
+}
@@ -16,15 +16,28 @@
 
 #include "SFZCommon.h"
 #include "SFZExtensions.h"
+#include "SFZRender.h"
 
 namespace sfzero
 {
-    class Synth :
+    class Voice;
+    class Sound;
+    class Channel;
+
+    /*********************************************************************************
+     *    SynthBase
+     *********************************************************************************/
+
+    /** Voice management and note handling common to Synth (one MIDI channel)
+        and MultiSynth (all MIDI channels) */
+
+    class SynthBase :
         public juce::Synthesiser,
-        public juce::ChangeBroadcaster
+        public juce::ChangeBroadcaster,
+        private juce::Timer
     {
     public:
-        
+
         // Parameters exposed to the GUI and MIDI control
         typedef enum {
             kParam_Volume = 0,
@@ -32,63 +45,190 @@ namespace sfzero
             kParam_Send,
             NumParameters
         } Parameters;
-        
+
+        SynthBase ();
+        virtual ~SynthBase();
+
+        /** Voices must be added and removed here rather than through juce::Synthesiser,
+            which keeps the lists of active and free voices in sync. */
+        Voice* addVoice (Voice *newVoice);
+        void   removeVoice (int index);
+        void   clearVoices ();
+
+        void noteOn  (int midiChannel, int midiNoteNumber, float velocity) override;
+        void noteOff (int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override;
+
+        // Handles bank & program selection and volume, pan, reverb, etc
+        void handleController     (int midiChannel, int controllerNumber, int controllerValue) override;
+        void handleProgramChange  (int midiChannel, int programNumber) override;
+
+        juce::String voiceInfoString();
+        int numVoicesUsed();
+
+        /** Blocks of voices in which streamed samples weren't read from disk in time,
+            summed over all voices. See SharedResources::setSFZPreloadTime(). */
+        int numStreamUnderruns();
+
+        /** Wait-free replacement for sendChangeMessage(), e.g. on the audio thread. Requests
+            are coalesced and sent as one change message from the message thread. */
+        void requestChangeMessage() { changeRequested_.set(1); }
+
+        /** Trade CPU for quality, e.g. sinc for offline bounces and linear for live playback.
+            Builds coefficient tables as needed, so call this from a non-realtime thread. */
+        void setInterpolationQuality (InterpolationQuality quality);
+        InterpolationQuality getInterpolationQuality();
+
+    protected:
+
+        /** State of a MIDI channel (1...16), or nullptr if not handled */
+        virtual Channel* getChannel (int midiChannel) = 0;
+
+        /** Selects a program on a channel. Wait-free, so program change messages are handled
+            right on the audio thread. Call under lock. */
+        void selectProgram (Channel &channel, const ProgramSelection& selection);
+
+        /** Pops a voice off the free stack, or steals one if allowed. Call under lock. */
+        Voice* acquireVoice (juce::SynthesiserSound *sound, int midiChannel, int midiNoteNumber, bool stealIfNoneAvailable);
+        /** Moves voices that have stopped from the active list to the free stack. Call under lock. */
+        void   releaseFinishedVoices ();
+
+        // Same as "voices", typed. Free voices are used last in, first out.
+        // Capacity is reserved when adding voices, so the audio thread never allocates.
+        std::vector<Voice*> allVoices_;
+        std::vector<Voice*> activeVoices_;
+        std::vector<Voice*> freeVoices_;
+        juce::Atomic<int>   numActiveVoices_;
+        juce::Atomic<int>   interpolation_;
+
+    private:
+        enum { changeMessageInterval = 50 }; // ms
+
+        void timerCallback() override;
+
+        juce::Atomic<int>   changeRequested_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SynthBase)
+    };
+
+    /*********************************************************************************
+     *    Channel
+     *********************************************************************************/
+
+    /** The sound (soundbank), program selection, volume, pan and reverb send of
+        a MIDI channel. Owned by a SynthBase, which serializes access with its lock. */
+
+    class Channel
+    {
+    public:
+
+        Channel (int midiChannel, SynthBase &owner);
+
+        int getMidiChannel() const { return midiChannel_; }
+
+        void   setSound (const juce::SynthesiserSound::Ptr &newSound);
+        Sound* getSound () { return sound_; }
+
+        int               getProgramCount(int bank);
+        juce::String      getProgramName (const ProgramSelection& selection);
+        ProgramSelection& getProgramSelection ();
+        ProgramList*      getProgramList();
+
+        /** Selects a program of the sound. Wait-free, see SynthBase::selectProgram(). */
+        void              setProgramSelection (const ProgramSelection& selection);
+        /** Selection requested by the last program change message, with the selected bank */
+        ProgramSelection& programChange (int programNumber);
+        bool              hasProgramSelectionChanged (bool reset);
+
+        // Volume, pan & reverb send, range 0...1 (see: SynthBase::Parameters)
+        float getParameter (int index);
+        void  setParameter (int index, float newValue);
+        bool  usesEffectsUnit();
+
+        // Multipliers for rendering
+        float getGainLeft()  { return masterVolume_.get() * masterPanL_.get(); }
+        float getGainRight() { return masterVolume_.get() * masterPanR_.get(); }
+        float getSendLevel() { return sendLevel_.get(); }
+
+        /** Handles bank selection, volume, pan, reverb & reset controllers.
+            Returns false if voices need to see the controller as well. */
+        bool handleController (int controllerNumber, int controllerValue);
+
+        int  getNoteVelocity (int midiNoteNumber) const { return noteVelocities_[midiNoteNumber]; }
+        void setNoteVelocity (int midiNoteNumber, int velocity) { noteVelocities_[midiNoteNumber] = velocity; }
+
+        std::unique_ptr<juce::XmlElement> getStateXML ();
+        bool setStateXML (const juce::XmlElement* xml);
+
+    private:
+
+        int midiChannel_;
+        SynthBase &owner_;
+        juce::SynthesiserSound::Ptr soundPtr_;
+        Sound* sound_;
+        int noteVelocities_[128];
+        ProgramSelection selectionCache_;
+        int selectedBank_MSB_;
+        juce::Atomic<int>   selectionChanged;
+        juce::Atomic<int>   sendLevelCC_;
+        juce::Atomic<float> sendLevel_;
+        juce::Atomic<int>   masterVolumeCC_;
+        juce::Atomic<float> masterVolume_;
+        juce::Atomic<int>   masterPanCC_;
+        juce::Atomic<float> masterPanL_, masterPanR_;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Channel)
+    };
+
+    /*********************************************************************************
+     *    Synth
+     *********************************************************************************/
+
+    /** Plays a single MIDI channel, see also MultiSynth */
+
+    class Synth : public SynthBase
+    {
+    public:
+
         Synth (int channel);
         virtual ~Synth();
-        
+
         // Safely swap sound under lock
         void swapSound (const juce::SynthesiserSound::Ptr &newSound);
-        
+
         // Safely select and query presets under lock
         virtual int               getProgramCount(int bank);
         virtual juce::String      getProgramName (const ProgramSelection& selection);
         virtual ProgramSelection& getProgramSelection ();
         virtual void              setProgramSelection (const ProgramSelection& selection);
         virtual ProgramList*      getProgramList();
-        
-        void noteOn  (int midiChannel, int midiNoteNumber, float velocity) override;
-        void noteOff (int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) override;
-        
+
         // Filters all messages not on my channel */
         void handleMidiEvent      (const juce::MidiMessage& m) override;
-        // Handles bank & program selection and volume, pan, reverb, etc
-        void handleController     (int midiChannel, int controllerNumber, int controllerValue) override;
-        void handleProgramChange  (int midiChannel, int programNumber) override;
         // Implement master volume & pan here:
         void renderVoices (juce::AudioSampleBuffer &outputAudio, int startSample, int numSamples) override;
-        
-        juce::String voiceInfoString();
-        int numVoicesUsed();        
-        
+
         // Control volume, pan & reverb send, range 0...1 (see: Synth::Parameters)
         float getParameter (int index);
         void  setParameter (int index, float newValue);
-        
+
         std::unique_ptr<juce::XmlElement> getStateXML ();
         bool setStateXML (const juce::XmlElement* xml);
-        
+
         /** Allow my ChangeListener to distinguish between program selection or other parameter changes */
         bool hasProgramSelectionChanged (bool reset = true);
-        
+
         bool usesEffectsUnit();
-        
+
         /** Return the only sound (soundbank actually), typecast to sfzero::Sound */
         Sound* getSound ();
-        
+
+    protected:
+        Channel* getChannel (int midiChannel) override;
+
     private:
-        
-        int channel_;
-        int noteVelocities_[128];
-        ProgramSelection selectionCache_;
-        int selectedBank_MSB_;
-        juce::Atomic<int>   selectionChanged;
-        juce::Atomic<int>   sendLevelCC_;
-        juce::Atomic<float> sendLevel_;
-        juce::Atomic<int>   masterVolumeCC_;
-        juce::Atomic<float> masterVolume_;
-        juce::Atomic<int>   masterPanCC_;
-        juce::Atomic<float> masterPanL_, masterPanR_;
-        
+
+        Channel channel_;
+
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Synth)
     };
 }
@@ -13,8 +13,10 @@
 
 #include "SFZDebug.h"
 #include "SFZRegion.h"
+#include "SFZRender.h"
 #include "SFZSample.h"
 #include "SFZSound.h"
+#include "SFZStreamPool.h"
 #include "SFZVoice.h"
 
 using namespace juce;
@@ -28,19 +30,31 @@ Voice::Voice() :
     noteGainL(0),
     noteGainR(0),
     pitchRatio(1),
-    sourceSamplePosition(0),
+    phaseIncrement(pitchRatioToPhaseIncrement(1.0)),
+    sourceSamplePhase(0),
     sampleStart(0),
     sampleEnd(0),
     loopStart(0),
     loopEnd(0),
     loopCounter(0),
-    curVelocity(0)
+    curVelocity(0),
+    interpolation(interpolateLinear),
+    usedSample(nullptr),
+    sampleBuffer(nullptr),
+    stream(nullptr),
+    streamStart(0),
+    streamOrigin(0),
+    underrun(false),
+    underruns(0),
+    activeSlot(-1),
+    midiChannel(1)
 {
     ampeg.setExponentialDecay(true);
 }
 
 Voice::~Voice()
 {
+    releaseSample();
 }
 
 bool Voice::canPlaySound (SynthesiserSound *sound)
@@ -55,6 +69,7 @@ void Voice::startNote(int midiNoteNumber,
 {
     Sound *sound = dynamic_cast<Sound *>(soundIn);
     
+    releaseSample();
     if (sound == nullptr)
     {
         killNote();
@@ -67,7 +82,17 @@ void Voice::startNote(int midiNoteNumber,
     {
         region = sound->getRegionFor (midiNoteNumber, velocity);
     }
-    if ((region == nullptr) || (region->sample == nullptr) || (region->sample->getBuffer() == nullptr))
+    if ((region == nullptr) || (region->sample == nullptr))
+    {
+        killNote();
+        return;
+    }
+    
+    // Keep sample data loaded on demand while playing, or don't play if not loaded
+    usedSample = region->sample;
+    usedSample->addUser();
+    sampleBuffer = usedSample->getBuffer();
+    if ((sampleBuffer == nullptr) && (usedSample->getInt16Data() == nullptr))
     {
         killNote();
         return;
@@ -103,10 +128,14 @@ void Voice::startNote(int midiNoteNumber,
     ampeg.startNote(&region->ampeg, floatVelocity, getSampleRate(), &region->ampeg_veltrack);
     
     // Offset/end.
-    sourceSamplePosition = static_cast<double>(region->offset);
+    sourceSamplePhase = samplePositionToPhase(region->offset);
     sampleStart = region->offset;
     sampleEnd = region->sample->getSampleLength();
-    if ((region->end > 0) && (region->end < sampleEnd))
+    if (region->end_from_sample_end)
+    {
+        sampleEnd = jlimit(static_cast<SamplePosition>(0), sampleEnd, sampleEnd + region->end);
+    }
+    else if ((region->end > 0) && (region->end < sampleEnd))
     {
         sampleEnd = region->end + 1;
     }
@@ -139,6 +168,8 @@ void Voice::startNote(int midiNoteNumber,
         }
     }
     loopCounter = 0;
+    
+    startStream();
 }
 
 void Voice::stopNote(float /*velocity*/, bool allowTailOff)
@@ -156,6 +187,10 @@ void Voice::stopNote(float /*velocity*/, bool allowTailOff)
     if (region->loop_mode == Region::loop_sustain)
     {
         // Continue playing, but stop looping.
+        if ((stream != nullptr) && (streamStart < loopEnd))
+        {
+            stream->releaseLoop(loopEnd - streamOrigin);
+        }
         loopEnd = loopStart;
     }
 }
@@ -205,95 +240,177 @@ void Voice::renderNextBlock (AudioSampleBuffer &outputBuffer, int startSample, i
     {
         return;
     }
-    // Simplified the code below for readability,
-    // Speculating on register-optimization does probably not make much sense.
-    // Fixed issues with very narrow loops.
-    
-    AudioSampleBuffer *buffer = region->sample->getBuffer();
-    int bufferSize = buffer->getNumSamples();
-    
-    const float *inL = buffer->getReadPointer(0, 0);
-    const float *inR = buffer->getNumChannels() > 1 ? buffer->getReadPointer(1, 0) : nullptr;
     
     float  *outL = outputBuffer.getWritePointer(0, startSample);
     float  *outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
     
-    float  ampegGain = ampeg.getLevel();
-    float  ampegSlope = ampeg.getSlope();
-    int    samplesUntilNextAmpSegment = ampeg.getSamplesUntilNextSegment();
-    bool   ampSegmentIsExponential = ampeg.getSegmentIsExponential();
-    bool   looping = (loopStart < loopEnd);
-    
-    while (--numSamples >= 0)
+    if (sampleBuffer != nullptr)
     {
-        // Simple linear interpolation between neighboring samples @ pos1, pos2
-        const SamplePosition pos1 = floor(sourceSamplePosition);
-        const float alpha = sourceSamplePosition - (double)pos1;
-        const float alphaInv = 1.0f - alpha;
-        SamplePosition pos2 = pos1 + 1;
-        
-        if (looping && (pos2 > loopEnd))
-            pos2 = loopStart;
-        
-        if (pos2 > bufferSize)
-            pos2 = bufferSize;
-        
-        jassert(pos1 >= 0 && pos1 < bufferSize && pos2 >= 0 && pos2 < bufferSize);
-        
-        float l = (inL[pos1] * alphaInv + inL[pos2] * alpha);
-        float r = inR ? (inR[pos1] * alphaInv + inR[pos2] * alpha) : l;
-        
-        // Shouldn't we dither here?
-        l *= (noteGainL * ampegGain);
-        r *= (noteGainR * ampegGain);
-        
-        if (outR)
+        const float *inL = sampleBuffer->getReadPointer(0, 0);
+        const float *inR = sampleBuffer->getNumChannels() > 1 ? sampleBuffer->getReadPointer(1, 0) : nullptr;
+        underrun = false;
+        renderRuns (inL, inR, sampleBuffer->getNumSamples(), outL, outR, numSamples);
+        if (underrun)
         {
-            *outL++ += l;
-            *outR++ += r;
-        }
-        else
-        {
-            *outL++ += (l + r) * 0.5f;
-        }
-        
-        // Advance to next sample
-        sourceSamplePosition += pitchRatio;
-        // Wrap around loop, if necessary
-        if (looping && (sourceSamplePosition >= loopEnd))
-        {
-            sourceSamplePosition = loopStart + (sourceSamplePosition - loopEnd);
-            loopCounter++;
+            ++underruns;
         }
+    }
+    else
+    {
+        const int16 *inL = region->sample->getInt16Data();
+        renderRuns (inL, static_cast<const int16*>(nullptr), static_cast<int>(region->sample->getSampleLength()), outL, outR, numSamples);
+    }
+}
+
+template <typename SampleType>
+void Voice::renderRuns (const SampleType *inL, const SampleType *inR, int bufferSize,
+                        float *outL, float *outR, int numSamples)
+{
+    // The amplitude EG is rendered into a gain buffer per chunk of frames. Each chunk
+    // is split into runs that end exactly at the next loop wrap or sample end, which
+    // are rendered by a branch-free kernel, and these events are handled in between
+    // runs only.
+    
+    bool   looping = (loopStart < loopEnd);
+    int    tapsBefore, tapsAfter;
+    getInterpolationReach (interpolation, tapsBefore, tapsAfter);
+    
+    const SamplePhase loopEndPhase = samplePositionToPhase(loopEnd);
+    const SamplePhase loopLengthPhase = samplePositionToPhase(loopEnd - loopStart);
+    const SamplePhase sampleEndPhase = samplePositionToPhase(sampleEnd);
+    
+    const typename RenderRun<SampleType>::Function renderKernel = getRenderRunFunction<SampleType> (interpolation, inR != nullptr, outR != nullptr);
+    
+    alignas(32) float gains[gainChunkSize];
+    
+    while (numSamples > 0)
+    {
+        const int chunkLength = jmin (numSamples, static_cast<int>(gainChunkSize));
+        const int audibleLength = ampeg.renderBlock(gains, chunkLength);
+        const float *gain = gains;
         
-        // Update EG
-        if (ampSegmentIsExponential)
+        for (int framesLeft = audibleLength; framesLeft > 0; )
         {
-            ampegGain *= ampegSlope;
-        }
-        else
-        {
-            ampegGain += ampegSlope;
-        }
-        if (--samplesUntilNextAmpSegment < 0)
-        {
-            ampeg.setLevel(ampegGain);
-            ampeg.nextSegment();
-            ampegGain = ampeg.getLevel();
-            ampegSlope = ampeg.getSlope();
-            samplesUntilNextAmpSegment = ampeg.getSamplesUntilNextSegment();
-            ampSegmentIsExponential = ampeg.getSegmentIsExponential();
+            if (sourceSamplePhase >= sampleEndPhase)
+            {
+                killNote();
+                return;
+            }
+            
+            int runLength = framesLeft;
+            
+            // Frames up to and including the one after which the position reaches the loop end or sample end
+            if (looping && sourceSamplePhase >= loopEndPhase)
+            {
+                // Started beyond the loop end: wrap after the first frame
+                runLength = 1;
+            }
+            else if (phaseIncrement > 0)
+            {
+                const SamplePhase eventPhase = looping ? jmin (loopEndPhase, sampleEndPhase) : sampleEndPhase;
+                const SamplePhase framesToEvent = (eventPhase - sourceSamplePhase + phaseIncrement - 1) / phaseIncrement;
+                if (framesToEvent < static_cast<SamplePhase>(runLength))
+                    runLength = static_cast<int>(framesToEvent);
+            }
+            
+            RenderRun<SampleType> run = { inL, inR, outL, outR, gain,
+                              sourceSamplePhase, phaseIncrement,
+                              noteGainL, noteGainR };
+            
+            // Read directly from the sample buffer where all taps are inside of it and do not
+            // cross the loop end. Otherwise, read from a window gathered with loop wrapping.
+            const int directFrames = framesWithDirectTaps (looping, bufferSize, tapsBefore, tapsAfter);
+            if (directFrames > 0)
+            {
+                runLength = jmin (runLength, directFrames);
+                renderKernel (run, runLength);
+            }
+            else
+            {
+                // Past the preloaded head of a streamed sample, the window is read from
+                // the stream, which has loops unrolled already
+                SampleType windowL[streamWindowSize], windowR[streamWindowSize];
+                const SamplePosition windowStart = samplePhaseIndex(sourceSamplePhase) - tapsBefore;
+                int windowSize = edgeWindowSize;
+                if (region->sample->isStreamed() && (windowStart >= streamOrigin))
+                {
+                    windowSize = streamWindowSize;
+                    if (!readStream (windowL, inR ? windowR : nullptr, windowStart - streamOrigin, windowSize))
+                    {
+                        underrun = true;
+                    }
+                }
+                else
+                {
+                    for (int i = 0; i < edgeWindowSize; ++i)
+                    {
+                        // Positions wrap like the playback phase: the loop end reads as
+                        // the loop start, so the loop plays like it was unrolled. This
+                        // changes looped output at the seam: the scalar renderer this
+                        // replaced read the frame at the loop end as the tap after it,
+                        // and wrapped only beyond it.
+                        SamplePosition pos = windowStart + i;
+                        while (looping && (pos >= loopEnd))
+                            pos -= loopEnd - loopStart;
+                        
+                        // Taps outside of the sample buffer read as silence
+                        const bool inside = (pos >= 0 && pos < bufferSize);
+                        windowL[i] = inside ? inL[pos] : SampleType();
+                        windowR[i] = (inside && inR) ? inR[pos] : SampleType();
+                    }
+                }
+                
+                // Rebase the phase to the window, and render all frames whose taps fit
+                const SamplePhase windowOrigin = samplePositionToPhase(windowStart + tapsBefore) - samplePositionToPhase(tapsBefore);
+                run.inL = windowL;
+                run.inR = inR ? windowR : nullptr;
+                run.phase = sourceSamplePhase - windowOrigin;
+                if (phaseIncrement > 0)
+                {
+                    const SamplePhase windowFrames = (samplePositionToPhase(windowSize - tapsAfter) - run.phase - 1) / phaseIncrement + 1;
+                    if (windowFrames < static_cast<SamplePhase>(runLength))
+                        runLength = static_cast<int>(windowFrames);
+                }
+                renderKernel (run, runLength);
+                run.phase += windowOrigin;
+            }
+            
+            sourceSamplePhase = run.phase;
+            gain = run.gains;
+            outL = run.outL;
+            outR = run.outR;
+            framesLeft -= runLength;
+            
+            // Wrap around loop, if necessary
+            while (looping && (sourceSamplePhase >= loopEndPhase))
+            {
+                sourceSamplePhase -= loopLengthPhase;
+                loopCounter++;
+                if (streamStart < loopEnd)
+                {
+                    streamOrigin -= loopEnd - loopStart;
+                }
+            }
+            
+            if (stream != nullptr)
+            {
+                stream->setConsumed(samplePhaseIndex(sourceSamplePhase) - tapsBefore - streamOrigin);
+            }
+            
+            if (sourceSamplePhase >= sampleEndPhase)
+            {
+                killNote();
+                return;
+            }
         }
         
-        if ((sourceSamplePosition >= sampleEnd) || ampeg.isDone())
+        if (ampeg.isDone())
         {
             killNote();
-            break;
+            return;
         }
+        numSamples -= chunkLength;
     }
-    
-    ampeg.setLevel(ampegGain);
-    ampeg.setSamplesUntilNextSegment(samplesUntilNextAmpSegment);
 }
 
 bool Voice::isPlayingNoteDown()
@@ -336,10 +453,14 @@ String Voice::infoString()
     }
 
 #if JUCE_DEBUG
+    // Samples per shdr record (sf2StoreLazy, SF3) have their name, and offsets relative
+    // to them. Other SF2 regions share one sample, and are named by their offset in it.
     SF2Sound* sf2sound = dynamic_cast<SF2Sound*>(sound);
     String* namePtr = (sf2sound == nullptr)
         ? nullptr
-        : sf2sound->sharedSamples()->sampleNameAt(region->offset);
+        : (region->sample->name.isNotEmpty()
+            ? &region->sample->name
+            : sf2sound->sharedSamples()->sampleNameAt(region->offset));
 #else
     String* namePtr = nullptr;
 #endif
@@ -382,11 +503,121 @@ void Voice::calcPitchRatio()
     
     // Code taken from from juce::SamplerVoice
     pitchRatio = pow (2.0, (pitch - (double)region->pitch_keycenter) / 12.0) * region->sample->getSampleRate() / getSampleRate();
+    phaseIncrement = pitchRatioToPhaseIncrement(pitchRatio);
+}
+
+int Voice::framesWithDirectTaps (bool looping, int bufferSize, int tapsBefore, int tapsAfter) const
+{
+    // Number of frames whose interpolator taps are all inside the sample buffer
+    // and, when looping, before the loop end, which wraps to the loop start.
+    if (phaseIncrement == 0 || samplePhaseIndex(sourceSamplePhase) < tapsBefore)
+        return 0;
+    
+    SamplePosition readLimit = bufferSize - 1;
+    if (looping)
+        readLimit = jmin (readLimit, loopEnd - 1);
+    
+    const SamplePhase readPhase = samplePositionToPhase(readLimit - tapsAfter + 1);
+    if (sourceSamplePhase >= readPhase)
+        return 0;
+    
+    const SamplePhase frames = (readPhase - sourceSamplePhase - 1) / phaseIncrement + 1;
+    return frames < static_cast<SamplePhase>(std::numeric_limits<int>::max()) ? static_cast<int>(frames) : std::numeric_limits<int>::max();
+}
+
+void Voice::setInterpolationQuality (InterpolationQuality quality)
+{
+    interpolation = quality;
 }
 
 void Voice::killNote()
 {
     region = nullptr;
+    releaseSample();
     clearCurrentNote();
 }
 
+void Voice::releaseSample()
+{
+    stopStream();
+    if (usedSample != nullptr)
+    {
+        usedSample->removeUser();
+        usedSample = nullptr;
+    }
+    sampleBuffer = nullptr;
+}
+
+void Voice::startStream()
+{
+    Sample *sample = region->sample;
+    if (!sample->isStreamed())
+    {
+        return;
+    }
+    
+    const SamplePosition headLength = sampleBuffer->getNumSamples();
+    if (sampleStart + edgeWindowSize <= headLength)
+    {
+        streamStart = headLength - edgeWindowSize;
+    }
+    else
+    {
+        streamStart = jmax(static_cast<SamplePosition>(0), sampleStart - edgeWindowSize);
+    }
+    streamOrigin = streamStart;
+    
+    // A loop within the head is never left, unless released (loop_sustain), so the
+    // stream would never be read
+    const bool looping = (loopStart < loopEnd);
+    if (looping && (sampleStart < loopEnd) && (loopEnd <= streamStart) && (region->loop_mode != Region::loop_sustain))
+    {
+        return;
+    }
+    
+    // Without a stream, the voice goes silent after the head, and counts underruns
+    if (StreamPool *pool = StreamPool::getInstanceWithoutCreating())
+    {
+        stream = pool->start(sample->getFile(), streamStart, loopStart, loopEnd, looping);
+    }
+}
+
+void Voice::stopStream()
+{
+    if (stream == nullptr)
+    {
+        return;
+    }
+    if (StreamPool *pool = StreamPool::getInstanceWithoutCreating())
+    {
+        pool->stop(stream);
+    }
+    stream = nullptr;
+}
+
+bool Voice::readStream (float *left, float *right, SamplePosition position, int numFrames)
+{
+    if (stream == nullptr)
+    {
+        FloatVectorOperations::clear(left, numFrames);
+        if (right != nullptr)
+        {
+            FloatVectorOperations::clear(right, numFrames);
+        }
+        return false;
+    }
+    return stream->read(left, right, position, numFrames);
+}
+
+bool Voice::readStream (int16 *left, int16 *right, SamplePosition /*position*/, int numFrames)
+{
+    // Only SFZ samples, which are float, are streamed
+    jassertfalse;
+    zeromem(left, numFrames * sizeof(int16));
+    if (right != nullptr)
+    {
+        zeromem(right, numFrames * sizeof(int16));
+    }
+    return false;
+}
+
@@ -15,10 +15,13 @@
 #define SFZVOICE_H_INCLUDED
 
 #include "SFZEG.h"
+#include "SFZRender.h"
 
 namespace sfzero
 {
     struct Region;
+    class Sample;
+    class SampleStream;
     
     class Voice : public juce::SynthesiserVoice
     {
@@ -49,9 +52,27 @@ namespace sfzero
         
         juce::String infoString();
         
+        // Interpolation used from the next rendered block on. Set by Synth.
+        void setInterpolationQuality (InterpolationQuality quality);
+        
+        // MIDI channel of the last started note, so a MultiSynth can mix voices per channel
+        int getMidiChannel() const { return midiChannel; }
+        
+        // Blocks in which a streamed sample wasn't read from disk in time
+        int getNumUnderruns() const { return underruns.get(); }
+        
     private:
         void    calcPitchRatio();
+        int     framesWithDirectTaps (bool looping, int bufferSize, int tapsBefore, int tapsAfter) const;
+        template <typename SampleType>
+        void    renderRuns (const SampleType *inL, const SampleType *inR, int bufferSize,
+                            float *outL, float *outR, int numSamples);
         void    killNote();
+        void    releaseSample();
+        void    startStream();
+        void    stopStream();
+        bool    readStream (float *left, float *right, SamplePosition position, int numFrames);
+        bool    readStream (juce::int16 *left, juce::int16 *right, SamplePosition position, int numFrames);
         
         Sound*  sound;
         Region* region;
@@ -60,7 +81,8 @@ namespace sfzero
         int     curMidiNote, curPitchWheel;
         float   noteGainL, noteGainR;
         double  pitchRatio;
-        double  sourceSamplePosition;
+        SamplePhase phaseIncrement;
+        SamplePhase sourceSamplePhase;
         EG      ampeg;
         SamplePosition sampleStart, sampleEnd;
         SamplePosition loopStart, loopEnd;
@@ -69,6 +91,28 @@ namespace sfzero
         int     loopCounter;
         int     curVelocity;
         
+        InterpolationQuality interpolation;
+        
+        // The sample of the current note, and its float data if any (see Sample::addUser())
+        Sample* usedSample;
+        juce::AudioSampleBuffer* sampleBuffer;
+        enum { edgeWindowSize = 64, streamWindowSize = 512, gainChunkSize = 256 };
+        
+        // Past the preloaded head of a streamed sample, frames are read from the stream.
+        // It starts edgeWindowSize frames before the end of the head, so edge windows
+        // gathered from the head never reach past it. The stream position of a sample
+        // position is that minus streamOrigin, which moves back by the loop length
+        // whenever the voice loops over the stream.
+        SampleStream*  stream;
+        SamplePosition streamStart, streamOrigin;
+        bool           underrun;
+        juce::Atomic<int> underruns;
+        
+        // Position in SynthBase's list of active voices, -1 if not in it
+        friend class SynthBase;
+        int     activeSlot;
+        int     midiChannel;
+        
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Voice)
     };
 }